@@ -6,16 +6,110 @@
 #include <stack>
 #include <cmath>
 #include <random>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <csignal>
+#include <cassert>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <errno.h>
+#endif
 
 #define PI 3.14159265359
 
 #define RENDER_WALLS 0x01
 #define RENDER_SHADED 0x02
 
+#define ALGORITHM_BACKTRACK 0
+#define ALGORITHM_BINARY_TREE 1
+#define ALGORITHM_SIDEWINDER 2
+#define ALGORITHM_PARALLEL_BACKTRACK 3
+
+#define DIRECTION_UNIFORM 0
+#define DIRECTION_RAND 1
+#define DIRECTION_WEIRD 2
+#define DIRECTION_HORIZONTAL 3
+#define DIRECTION_VERTICAL 4
+#define DIRECTION_CHANGING 5
+
+#define DIRECTION_BIAS_RANGE 10
+
+#define POLAR_RING_HEIGHT 8
+
+#define TOPOLOGY_SQUARE 0
+#define TOPOLOGY_HEX 1
+#define TOPOLOGY_TRIANGLE 2
+#define TOPOLOGY_CUBE 3
+
+#define PHASE_IDLE 0
+#define PHASE_GENERATING 1
+#define PHASE_DISTANCES 2
+#define PHASE_RENDERING 3
+#define PHASE_SAVING 4
+
+#define PROGRESS_BATCH 4096
+#define PROGRESS_INTERVAL_MS 1000
+
+#define CANCEL_TIME_BUDGET 1000
+
+#define DISTANCE_PARALLEL_CELLS (1 << 16)
+
+#define SMALL_MAZE_CHUNK 65536
+#define SMALL_MAZE_BENCH_BATCH 1024
+
+#define OUTPUT_WALLS 0
+#define OUTPUT_WALLS_SHADED 1
+#define OUTPUT_SHADED 2
+#define OUTPUT_THUMBNAIL 3
+#define OUTPUT_KIND_COUNT 4
+
+#define THUMBNAIL_SIZE 128
+
+#define VIEW_WIDTH 1024
+#define VIEW_HEIGHT 768
+#define VIEW_MAX_ZOOM 32.0
+#define VIEW_ZOOM_STEP 1.25
+#define VIEW_PAN_STEP 64
+#define VIEW_IDLE_DELAY_MS 10
+#define VIEW_BACKGROUND 0x40404000
+
+#define STRATEGY_IN_MEMORY 0
+#define STRATEGY_COMPACT 1
+#define STRATEGY_STREAMING 2
+#define STRATEGY_COUNT 3
+#define STRATEGY_NONE STRATEGY_COUNT
+
+#define STREAM_BAND_BYTES (64ULL << 20)
+#define MAZE_MAX_SIDE 0x7fffffffULL
+
+// 14+40+12 bytes of headers, padded so the mapped pixels are 4 byte aligned
+#define BMP_HEADER_SIZE 68
+#define BMP_MAX_FILE_SIZE 0xffffffffULL
+
+#define CACHE_FORMAT_VERSION 1
+#define CACHE_DEFAULT_SIZE_MB 1024
+#define CACHE_STALE_TEMPORARY 3600
+
 typedef uint8_t uint8;
 typedef uint16_t uint16;
 typedef uint32_t uint32;
 typedef uint64_t uint64;
+typedef int32_t int32;
+typedef int64_t int64;
 
 static std::random_device rd;
 static std::mt19937 engine(rd());
@@ -23,27 +117,247 @@ static std::uniform_int_distribution<int> directionsDist(0, 3);
 static std::uniform_int_distribution<int> colorComponentDist(0, 255);
 static std::uniform_int_distribution<int> colorDist(0, 0xffffff);
 
+static uint32 workerCount = 1;
+
 struct Coordinates
 {
     uint32 X;
     uint32 Y;
 };
 
-struct Cell
+// Square : 0 north, 1 east, 2 south, 3 west
+struct SquareTopology
+{
+    static const int NeighbourCount = 4;
+
+    static int opposite(int direction) { return (direction+2)%4; }
+
+    template<typename MazeType>
+    static bool step(MazeType &maze, Coordinates cursor, int direction, Coordinates &next)
+    {
+        next = cursor;
+        switch(direction)
+        {
+        case 0:
+            next.X--;
+            return cursor.X > 0;
+        case 1:
+            next.Y++;
+            return next.Y < maze.width;
+        case 2:
+            next.X++;
+            return next.X < maze.height;
+        case 3:
+            next.Y--;
+            return cursor.Y > 0;
+        }
+        return false;
+    }
+};
+
+// Hexagons, pointy top, odd rows shifted half a cell to the east :
+// 0 north east, 1 east, 2 south east, 3 south west, 4 west, 5 north west
+struct HexTopology
+{
+    static const int NeighbourCount = 6;
+
+    static int opposite(int direction) { return (direction+3)%6; }
+
+    template<typename MazeType>
+    static bool step(MazeType &maze, Coordinates cursor, int direction, Coordinates &next)
+    {
+        uint32 shift = cursor.X & 1;
+        next = cursor;
+        switch(direction)
+        {
+        case 0:
+            next.X--;
+            next.Y += shift;
+            return cursor.X > 0 && next.Y < maze.width;
+        case 1:
+            next.Y++;
+            return next.Y < maze.width;
+        case 2:
+            next.X++;
+            next.Y += shift;
+            return next.X < maze.height && next.Y < maze.width;
+        case 3:
+            next.X++;
+            next.Y -= 1 - shift;
+            return next.X < maze.height && (shift || cursor.Y > 0);
+        case 4:
+            next.Y--;
+            return cursor.Y > 0;
+        case 5:
+            next.X--;
+            next.Y -= 1 - shift;
+            return cursor.X > 0 && (shift || cursor.Y > 0);
+        }
+        return false;
+    }
+};
+
+// Triangles alternating up and down, a cell points up when X+Y is even :
+// 0 across the flat side (south when pointing up, north otherwise),
+// 1 east, 2 west
+struct TriangleTopology
+{
+    static const int NeighbourCount = 3;
+
+    static int opposite(int direction) { return (3-direction)%3; }
+
+    template<typename MazeType>
+    static bool step(MazeType &maze, Coordinates cursor, int direction, Coordinates &next)
+    {
+        next = cursor;
+        switch(direction)
+        {
+        case 0:
+            if(((cursor.X + cursor.Y) & 1) == 0)
+            {
+                next.X++;
+                return next.X < maze.height;
+            }
+            next.X--;
+            return cursor.X > 0;
+        case 1:
+            next.Y++;
+            return next.Y < maze.width;
+        case 2:
+            next.Y--;
+            return cursor.Y > 0;
+        }
+        return false;
+    }
+};
+
+// Stacked square layers, layer Z is stored in rows [Z*layerHeight, (Z+1)*layerHeight)
+// 0 north, 1 east, 2 south, 3 west like the square grid, 4 up, 5 down
+struct CubeTopology
+{
+    static const int NeighbourCount = 6;
+
+    static int opposite(int direction) { return (direction < 4) ? (direction+2)%4 : 9-direction; }
+
+    template<typename MazeType>
+    static bool step(MazeType &maze, Coordinates cursor, int direction, Coordinates &next)
+    {
+        uint32 layerHeight = maze.layerHeight;
+        next = cursor;
+        switch(direction)
+        {
+        case 0:
+            next.X--;
+            return (cursor.X % layerHeight) > 0;
+        case 1:
+            next.Y++;
+            return next.Y < maze.width;
+        case 2:
+            next.X++;
+            return (next.X % layerHeight) > 0;
+        case 3:
+            next.Y--;
+            return cursor.Y > 0;
+        case 4:
+            next.X += layerHeight;
+            return next.X < maze.height;
+        case 5:
+            next.X -= layerHeight;
+            return cursor.X >= layerHeight;
+        }
+        return false;
+    }
+};
+
+template<typename Topology>
+struct CellT
 {
     Coordinates position;
     uint32 distFromStart;
     uint32 visited;
-    Cell *neighbours[4];
+    CellT *neighbours[Topology::NeighbourCount];
 };
 
-struct Maze
+// height counts the rows of every layer, depth is 1 for the flat mazes
+template<typename Topology>
+struct MazeT
 {
     uint32 width;
     uint32 height;
+    uint32 depth;
+    uint32 layerHeight;
     Coordinates start;
     uint32 maxDistance;
-    Cell **cells;
+    uint64 seed;
+    CellT<Topology> **cells;
+};
+
+typedef CellT<SquareTopology> Cell;
+typedef MazeT<SquareTopology> Maze;
+
+// One bit per cell, set when the cell is open north / west
+// A band of a bigger maze holds its rows from firstRow on.
+struct WallBits
+{
+    uint32 width;
+    uint32 height;
+    uint32 firstRow;
+    uint32 wordsPerRow;
+    uint64 *north;
+    uint64 *west;
+};
+
+// Ring 0 is the center cell, every ring has a multiple of the sectors of
+// the one inside it
+struct PolarCell
+{
+    uint32 visited;
+    uint8 openInward;
+    uint8 openClockwise;
+};
+
+struct PolarMaze
+{
+    uint32 rings;
+    uint32 *ringSectors;
+    uint32 *ringOffsets; // rings+1 entries, the last one is the cell count
+    uint32 start;
+    PolarCell *cells;
+};
+
+struct ArcSpan
+{
+    int32 row;
+    int32 firstColumn;
+    int32 lastColumn;
+    uint32 sector;
+};
+
+// Top-down BMP file mapped in memory, surface is a view over its pixels
+struct MappedImage
+{
+    int file;
+    uint8 *mapping;
+    uint64 mappingSize;
+    SDL_Surface surface;
+};
+
+// Rectangle of cells, max is exclusive
+struct Region
+{
+    Coordinates min;
+    Coordinates max;
+};
+
+struct MazeStats
+{
+    uint64 degreeCounts[5];
+    uint64 corridorCount;
+    std::vector<uint64> corridorLengths;
+    uint32 solutionLength;
+    uint32 diameter;
+    Coordinates diameterStart;
+    Coordinates diameterEnd;
 };
 
 struct RGBcolor
@@ -53,20 +367,106 @@ struct RGBcolor
     uint8 blue;
 };
 
-int randomDir_usingRand() {
-    return rand()%4;
+// Published by the hot loops every PROGRESS_BATCH steps or once per row,
+// where they also look at cancelReason
+struct Progress
+{
+    std::atomic<int> phase;
+    std::atomic<int> mazeIndex;
+    std::atomic<uint64> cellsVisited;
+    std::atomic<uint64> rowsRendered;
+    std::atomic<uint64> bytesWritten;
+    std::atomic<uint64> phaseStart;
+    std::atomic<uint64> totalCells;
+    std::atomic<uint64> totalRows;
+    std::atomic<uint64> rowSize;
+    std::atomic<bool> mappedOutput;
+};
+
+struct ProgressReporter
+{
+    bool toStderr;
+    const char *statusFilename;
+    double timeBudget;
+    int mazeCount;
+    std::chrono::steady_clock::time_point start;
+    std::atomic<bool> done;
+};
+
+static Progress progress;
+static std::atomic<int> cancelReason(0);
+
+inline bool isCancelled()
+{
+    return cancelReason.load(std::memory_order_relaxed) != 0;
+}
+
+inline bool progress_addCells(uint64 count)
+{
+    progress.cellsVisited.fetch_add(count, std::memory_order_relaxed);
+    return isCancelled();
+}
+
+inline bool progress_addRows(uint64 count)
+{
+    progress.rowsRendered.fetch_add(count, std::memory_order_relaxed);
+    if(progress.mappedOutput.load(std::memory_order_relaxed))
+        progress.bytesWritten.fetch_add(count*progress.rowSize.load(std::memory_order_relaxed),
+                                        std::memory_order_relaxed);
+    return isCancelled();
+}
+
+inline uint64 progress_now()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void progress_setPhase(int phase)
+{
+    progress.cellsVisited.store(0, std::memory_order_relaxed);
+    progress.phaseStart.store(progress_now(), std::memory_order_relaxed);
+    progress.phase.store(phase, std::memory_order_relaxed);
+}
+
+void cancelHandler(int signalNumber)
+{
+    cancelReason.store(signalNumber);
+}
+
+// No engine means rand() and the global engine
+struct DirectionRandom
+{
+    std::mt19937 *ownEngine;
+
+    uint32 next()
+    {
+        return ownEngine ? (uint32)(*ownEngine)() : (uint32)rand();
+    }
+
+    int uniform()
+    {
+        if(!ownEngine)
+            return directionsDist(engine);
+        std::uniform_int_distribution<int> directions(0, 3);
+        return directions(*ownEngine);
+    }
+};
+
+int randomDir_usingRand(DirectionRandom &random) {
+    return random.next()%4;
 }
 
-int randomDir_uniform() {
-    return directionsDist(engine);
+int randomDir_uniform(DirectionRandom &random) {
+    return random.uniform();
 }
 
-int randomDir_weird() {
-    return (rand()%2 + rand()%2 + rand()%2 + rand()%2)%4;
+int randomDir_weird(DirectionRandom &random) {
+    return (random.next()%2 + random.next()%2 + random.next()%2 + random.next()%2)%4;
 }
 
-int randomDir_horizontal(int range) {
-    int dir = rand()%range;
+int randomDir_horizontal(DirectionRandom &random, int range) {
+    int dir = random.next()%range;
 
     int ret;
     if(dir < 1)
@@ -81,8 +481,8 @@ int randomDir_horizontal(int range) {
     return ret;
 }
 
-int randomDir_vertical(int range) {
-    int dir = rand()%range;
+int randomDir_vertical(DirectionRandom &random, int range) {
+    int dir = random.next()%range;
 
     int ret;
     if(dir < 1)
@@ -97,553 +497,3602 @@ int randomDir_vertical(int range) {
     return ret;
 }
 
-int randomDir_changing(int prevDir) {
+int randomDir_changing(DirectionRandom &random, int prevDir) {
     int ret = 0;
     switch(prevDir)
     {
     case 0:
     case 2:
-        ret = randomDir_horizontal(100);
+        ret = randomDir_horizontal(random, 100);
         break;
     case 1:
     case 3:
-        ret = randomDir_vertical(100);
+        ret = randomDir_vertical(random, 100);
         break;
     }
 
     return ret;
 }
 
-void process_distanceFromStart(Maze &maze)
+// Direction policies for generate_recursiveBacktrack, moved() gets the
+// direction that was carved
+struct DirectionPolicy_Uniform
 {
-    uint32 distance = 0, maxDistance = 0;
+    DirectionRandom random;
+    int next() { return randomDir_uniform(random); }
+    void moved(int) {}
+};
 
-    for(uint32 X = 0;
-        X < maze.height;
-        ++X)
+struct DirectionPolicy_Rand
+{
+    DirectionRandom random;
+    int next() { return randomDir_usingRand(random); }
+    void moved(int) {}
+};
+
+struct DirectionPolicy_Weird
+{
+    DirectionRandom random;
+    int next() { return randomDir_weird(random); }
+    void moved(int) {}
+};
+
+template<int Range>
+struct DirectionPolicy_Horizontal
+{
+    static_assert(Range >= 4, "Every direction needs at least one slot");
+    DirectionRandom random;
+    int next() { return randomDir_horizontal(random, Range); }
+    void moved(int) {}
+};
+
+template<int Range>
+struct DirectionPolicy_Vertical
+{
+    static_assert(Range >= 4, "Every direction needs at least one slot");
+    DirectionRandom random;
+    int next() { return randomDir_vertical(random, Range); }
+    void moved(int) {}
+};
+
+template<int NeighbourCount>
+struct DirectionPolicy_UniformN
+{
+    DirectionRandom random;
+    int next()
     {
-        for(uint32 Y = 0;
-            Y < maze.width;
-            ++Y)
-        {
-            maze.cells[X][Y].visited = 0;
-        }
+        std::uniform_int_distribution<int> neighboursDist(0, NeighbourCount-1);
+        return random.ownEngine ? neighboursDist(*random.ownEngine) : neighboursDist(engine);
     }
-    std::stack<Cell *> backtrack;
-    backtrack.push(&maze.cells[maze.start.X][maze.start.Y]);
+    void moved(int) {}
+};
 
-    while(!backtrack.empty())
+struct DirectionPolicy_Changing
+{
+    DirectionRandom random;
+    int previousDirection;
+    int next() { return randomDir_changing(random, previousDirection); }
+    void moved(int direction) { previousDirection = direction; }
+};
+
+// The maze is a tree, so subtrees can be walked by different workers without
+// visited marks. Starving workers get the oldest pending subtrees.
+template<typename Topology>
+struct DistanceTask
+{
+    CellT<Topology> *cell;
+    CellT<Topology> *parent;
+    uint32 distance;
+};
+
+template<typename Topology>
+struct DistanceWork
+{
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<DistanceTask<Topology> > pool;
+    std::atomic<uint32> starvingWorkers;
+    uint32 activeWorkers;
+    bool finished;
+    uint32 maxDistance;
+};
+
+template<typename Topology>
+void process_distanceWorker(DistanceWork<Topology> *work)
+{
+    typedef CellT<Topology> Cell;
+    typedef DistanceTask<Topology> Task;
+
+    std::deque<Task> pending;
+    uint32 maxDistance = 0;
+    uint32 pendingCells = 0;
+    for(;;)
     {
-        Cell *cursor = backtrack.top();
-        maze.cells[cursor->position.X][cursor->position.Y].visited++;
+        if(pending.empty())
+        {
+            std::unique_lock<std::mutex> lock(work->mutex);
+            work->activeWorkers--;
+            while(work->pool.empty() && !work->finished)
+            {
+                if(work->activeWorkers == 0)
+                {
+                    work->finished = true;
+                    work->wakeUp.notify_all();
+                    break;
+                }
+                work->starvingWorkers++;
+                work->wakeUp.wait(lock);
+                work->starvingWorkers--;
+            }
+            if(work->finished)
+            {
+                break;
+            }
+            pending.push_back(work->pool.front());
+            work->pool.pop_front();
+            work->activeWorkers++;
+        }
 
-        bool unvisitedNeighbours = false;
-        for (int i = 0; i < 4; ++i)
+        Task task = pending.back();
+        pending.pop_back();
+
+        Cell *cell = task.cell;
+        cell->distFromStart = task.distance;
+        if(task.distance > maxDistance)
         {
-            Cell *neighbour = cursor->neighbours[i];
-            if(neighbour != NULL)
+            maxDistance = task.distance;
+        }
+        for(int i = 0; i < Topology::NeighbourCount; ++i)
+        {
+            Cell *neighbour = cell->neighbours[i];
+            if(neighbour != NULL && neighbour != task.parent)
             {
-                unvisitedNeighbours |= (maze.cells[neighbour->position.X][neighbour->position.Y].visited == 0);
+                Task next = { neighbour, cell, task.distance + 1 };
+                pending.push_back(next);
             }
         }
 
-        if(unvisitedNeighbours)
+        if(++pendingCells == PROGRESS_BATCH)
         {
-            int direction;
-            Cell *next = NULL;
-            while(next == NULL)
+            pendingCells = 0;
+            if(progress_addCells(PROGRESS_BATCH))
             {
-                direction = rand() % 4;
-                next = cursor->neighbours[direction];
+                std::lock_guard<std::mutex> lock(work->mutex);
+                work->finished = true;
+                work->wakeUp.notify_all();
+                break;
             }
 
-            if(maze.cells[next->position.X][next->position.Y].visited == 0)
+            if(work->starvingWorkers.load(std::memory_order_relaxed) > 0 && pending.size() > 1)
             {
-                backtrack.push(next);
-                maze.cells[next->position.X][next->position.Y].visited++;
-                cursor->distFromStart = distance++;
-                if(distance > maxDistance)
+                std::lock_guard<std::mutex> lock(work->mutex);
+                size_t shared = pending.size() / 2;
+                for(size_t i = 0; i < shared; ++i)
                 {
-                    maxDistance = distance;
+                    work->pool.push_back(pending.front());
+                    pending.pop_front();
                 }
-                cursor = next;
-            }
-        }
-        else
-        {
-            if(backtrack.size()>1) {
-                cursor->distFromStart = distance--;
-                cursor = backtrack.top();
+                work->wakeUp.notify_all();
             }
-            backtrack.pop();
         }
     }
 
-    maze.maxDistance = maxDistance;
+    progress_addCells(pendingCells);
+
+    std::lock_guard<std::mutex> lock(work->mutex);
+    if(maxDistance > work->maxDistance)
+    {
+        work->maxDistance = maxDistance;
+    }
+}
+
+template<typename Topology>
+void process_distanceFromStart(MazeT<Topology> &maze)
+{
+    DistanceWork<Topology> work;
+    work.starvingWorkers.store(0);
+    work.finished = false;
+    work.maxDistance = 0;
+
+    DistanceTask<Topology> root = { &maze.cells[maze.start.X][maze.start.Y], NULL, 0 };
+    work.pool.push_back(root);
+
+    uint64 cellCount = (uint64)maze.width*maze.height;
+    uint32 threadCount = workerCount;
+    if(cellCount < DISTANCE_PARALLEL_CELLS)
+    {
+        threadCount = 1;
+    }
+    work.activeWorkers = threadCount;
+
+    std::vector<std::thread> workers;
+    for(uint32 i = 1; i < threadCount; ++i)
+    {
+        workers.push_back(std::thread(process_distanceWorker<Topology>, &work));
+    }
+    process_distanceWorker(&work);
+    for(uint32 i = 0; i < workers.size(); ++i)
+    {
+        workers[i].join();
+    }
+
+    maze.maxDistance = work.maxDistance;
+}
+
+template<typename Topology>
+inline Region wholeMaze(MazeT<Topology> &maze)
+{
+    Region region = {};
+    region.max.X = maze.height;
+    region.max.Y = maze.width;
+    return region;
+}
+
+inline bool isInRegion(Region &region, Coordinates cell)
+{
+    return cell.X >= region.min.X && cell.X < region.max.X &&
+           cell.Y >= region.min.Y && cell.Y < region.max.Y;
 }
 
-void generate_recursiveBacktrack(Maze &maze, int (*randomDir)())
+// Only walks the cells of region, returns the cell it started from
+template<typename Topology, typename DirectionPolicy>
+Coordinates generate_recursiveBacktrack(MazeT<Topology> &maze, DirectionPolicy &randomDir, Region region)
 {
     std::stack<Coordinates> backtrack;
     Coordinates cursor = {};
-    cursor.X = rand() % maze.height;
-    cursor.Y = rand() % maze.width;
-
-    maze.start = cursor;
+    cursor.X = region.min.X + randomDir.random.next() % (region.max.X - region.min.X);
+    cursor.Y = region.min.Y + randomDir.random.next() % (region.max.Y - region.min.Y);
+    Coordinates start = cursor;
 
     backtrack.push(cursor);
     maze.cells[cursor.X][cursor.Y].visited++;
+    uint32 pendingCells = 1;
     while(!backtrack.empty())
     {
         bool unvisitedNeighbours = false;
 
-        if(cursor.X < maze.height-1)
-            unvisitedNeighbours |= (!maze.cells[cursor.X+1][cursor.Y].visited &&
-                                    cursor.X+1 < maze.height);
-        if(cursor.X > 0)
-            unvisitedNeighbours |= (!maze.cells[cursor.X-1][cursor.Y].visited &&
-                                    cursor.X-1 < maze.height);
-        if(cursor.Y < maze.width-1)
-            unvisitedNeighbours |= (!maze.cells[cursor.X][cursor.Y+1].visited &&
-                                    cursor.Y+1 < maze.width);
-        if(cursor.Y > 0)
-            unvisitedNeighbours |= (!maze.cells[cursor.X][cursor.Y-1].visited &&
-                                    cursor.Y-1 < maze.width);
+        Coordinates next = cursor;
+        for(int i = 0; i < Topology::NeighbourCount; ++i)
+        {
+            if(Topology::step(maze, cursor, i, next) && isInRegion(region, next))
+                unvisitedNeighbours |= !maze.cells[next.X][next.Y].visited;
+        }
 
         if(unvisitedNeighbours)
         {
-            Coordinates next = cursor;
             int direction = 0;
-
-            while(  next.X >= maze.height ||
-                    next.Y >= maze.width ||
-                    maze.cells[next.X][next.Y].visited )
+            do
             {
-                direction = randomDir();
-                next = cursor;
-
-                switch(direction)
-                {
-                case 0:
-                    next.X--;
-                    break;
-                case 1:
-                    next.Y++;
-                    break;
-                case 2:
-                    next.X++;
-                    break;
-                case 3:
-                    next.Y--;
-                    break;
-                }
-            }
+                direction = randomDir.next();
+            } while(!Topology::step(maze, cursor, direction, next) ||
+                    !isInRegion(region, next) ||
+                    maze.cells[next.X][next.Y].visited);
 
             backtrack.push(next);
             maze.cells[next.X][next.Y].visited++;
             maze.cells[cursor.X][cursor.Y].neighbours[direction] = &maze.cells[next.X][next.Y];
-            maze.cells[next.X][next.Y].neighbours[(direction+2)%4] = &maze.cells[cursor.X][cursor.Y];
+            maze.cells[next.X][next.Y].neighbours[Topology::opposite(direction)] = &maze.cells[cursor.X][cursor.Y];
+            randomDir.moved(direction);
             cursor = next;
+
+            if(++pendingCells == PROGRESS_BATCH)
+            {
+                pendingCells = 0;
+                if(progress_addCells(PROGRESS_BATCH))
+                    return start;
+            }
         }
         else
         {
-            cursor = backtrack.top();
             backtrack.pop();
+            if(!backtrack.empty())
+                cursor = backtrack.top();
         }
     }
+
+    progress_addCells(pendingCells);
+    return start;
 }
 
-void generate_binaryTree(Maze &maze)
+// SplitMix64 of seed + counter, rows get the same draws in any order
+inline uint64 random_counter64(uint64 seed, uint64 counter)
 {
-    for(uint32 X = 0;
-        X < maze.height;
-        ++X)
-    {
-        for(uint32 Y = 0;
-            Y < maze.width;
-            ++Y)
-        {
-            if(X != 0 || Y != 0)
-            {
-                Coordinates target;
-                target.X = X;
-                target.Y = Y;
+    uint64 Z = seed + counter*0x9e3779b97f4a7c15ULL;
+    Z = (Z ^ (Z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    Z = (Z ^ (Z >> 27)) * 0x94d049bb133111ebULL;
+    return Z ^ (Z >> 31);
+}
 
-                int direction = (rand() % 2 + 3)%4; // Yields either 0 or 3
-                if(X == 0) direction = 3;
-                if(Y == 0) direction = 0;
+inline uint64 wallBits_tailMask(uint32 width)
+{
+    uint32 tail = width % 64;
+    return (tail == 0) ? ~0ULL : ((1ULL << tail) - 1);
+}
 
-                switch(direction)
-                {
-                case 0:
-                    target.X--;
-                    break;
-                case 3:
-                    target.Y--;
-                    break;
-                }
+// One contiguous block of rows per worker
+template<typename RowFunction>
+void parallel_forRows(uint32 rowCount, RowFunction rowFunction)
+{
+    uint32 threadCount = workerCount;
+    if(threadCount > rowCount)
+        threadCount = rowCount;
 
-                maze.cells[X][Y].neighbours[direction] = &maze.cells[target.X][target.Y];
-                maze.cells[target.X][target.Y].neighbours[(direction+2)%4] = &maze.cells[X][Y];
-            }
-        }
+    if(threadCount <= 1)
+    {
+        rowFunction(0, rowCount);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    uint32 rowsPerThread = rowCount / threadCount;
+    uint32 remainder = rowCount % threadCount;
+    uint32 firstRow = 0;
+    for(uint32 i = 0; i < threadCount; ++i)
+    {
+        uint32 endRow = firstRow + rowsPerThread + (i < remainder ? 1 : 0);
+        workers.push_back(std::thread(rowFunction, firstRow, endRow));
+        firstRow = endRow;
+    }
+    for(uint32 i = 0; i < workers.size(); ++i)
+    {
+        workers[i].join();
     }
 }
 
-void buildMaze(Maze &maze, int (*randomDir)())
+// Same split as parallel_forRows, the workers stay alive between calls
+struct WorkerPool
 {
-    maze.cells = (Cell **)malloc(sizeof(Cell*)*maze.height);
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable finished;
+    std::function<void(uint32, uint32)> rowFunction;
+    uint32 blockCount;
+    uint32 rowCount;
+    uint32 generation;
+    uint32 busyWorkers;
+    bool stopping;
+};
 
-    // Creating all of the cells with closed doors
-    for(uint32 X = 0;
-        X < maze.height;
-        ++X)
+inline void workerPool_block(uint32 rowCount, uint32 blockCount, uint32 block,
+                             uint32 &firstRow, uint32 &endRow)
+{
+    uint32 rowsPerBlock = rowCount / blockCount;
+    uint32 remainder = rowCount % blockCount;
+    firstRow = block*rowsPerBlock + (block < remainder ? block : remainder);
+    endRow = firstRow + rowsPerBlock + (block < remainder ? 1 : 0);
+}
+
+void workerPool_worker(WorkerPool *pool, uint32 block)
+{
+    uint32 generation = 0;
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    for(;;)
+    {
+        while(pool->generation == generation && !pool->stopping)
+        {
+            pool->wakeUp.wait(lock);
+        }
+        if(pool->stopping)
+        {
+            break;
+        }
+        generation = pool->generation;
+
+        uint32 firstRow, endRow;
+        workerPool_block(pool->rowCount, pool->blockCount, block, firstRow, endRow);
+        lock.unlock();
+        if(firstRow < endRow)
+        {
+            pool->rowFunction(firstRow, endRow);
+        }
+        lock.lock();
+
+        if(--pool->busyWorkers == 0)
+        {
+            pool->finished.notify_one();
+        }
+    }
+}
+
+void workerPool_start(WorkerPool &pool, uint32 threadCount)
+{
+    pool.blockCount = (threadCount > 1) ? threadCount : 1;
+    pool.rowCount = 0;
+    pool.generation = 0;
+    pool.busyWorkers = 0;
+    pool.stopping = false;
+    for(uint32 i = 1; i < pool.blockCount; ++i)
+    {
+        pool.threads.push_back(std::thread(workerPool_worker, &pool, i));
+    }
+}
+
+void workerPool_stop(WorkerPool &pool)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stopping = true;
+    }
+    pool.wakeUp.notify_all();
+    for(uint32 i = 0; i < pool.threads.size(); ++i)
+    {
+        pool.threads[i].join();
+    }
+    pool.threads.clear();
+}
+
+// The calling thread takes the first block
+template<typename RowFunction>
+void workerPool_forRows(WorkerPool &pool, uint32 rowCount, RowFunction rowFunction)
+{
+    if(pool.threads.empty())
+    {
+        rowFunction(0, rowCount);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.rowFunction = rowFunction;
+        pool.rowCount = rowCount;
+        pool.busyWorkers = (uint32)pool.threads.size();
+        pool.generation++;
+    }
+    pool.wakeUp.notify_all();
+
+    uint32 firstRow, endRow;
+    workerPool_block(rowCount, pool.blockCount, 0, firstRow, endRow);
+    if(firstRow < endRow)
+    {
+        rowFunction(firstRow, endRow);
+    }
+
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    while(pool.busyWorkers)
+    {
+        pool.finished.wait(lock);
+    }
+}
+
+void buildWallBits(WallBits &bits, uint32 width, uint32 height)
+{
+    bits.width = width;
+    bits.height = height;
+    bits.firstRow = 0;
+    bits.wordsPerRow = (width + 63) / 64;
+
+    uint64 wordCount = (uint64)bits.wordsPerRow * height;
+    bits.north = (uint64 *)malloc(sizeof(uint64)*wordCount);
+    bits.west = (uint64 *)malloc(sizeof(uint64)*wordCount);
+}
+
+void destroyWallBits(WallBits &bits)
+{
+    free(bits.north);
+    free(bits.west);
+}
+
+void generate_binaryTree(WallBits &bits, uint64 seed)
+{
+    uint32 wordsPerRow = bits.wordsPerRow;
+    uint64 tailMask = wallBits_tailMask(bits.width);
+
+    parallel_forRows(bits.height, [&](uint32 firstRow, uint32 endRow)
+    {
+        for(uint32 X = firstRow;
+            X < endRow;
+            ++X)
+        {
+            uint64 *north = bits.north + (uint64)X*wordsPerRow;
+            uint64 *west = bits.west + (uint64)X*wordsPerRow;
+            uint64 row = (uint64)bits.firstRow + X;
+            uint64 counter = row*wordsPerRow;
+
+            if(row == 0)
+            {
+                for(uint32 W = 0; W < wordsPerRow; ++W)
+                {
+                    north[W] = 0;
+                    west[W] = ~0ULL;
+                }
+            }
+            else
+            {
+                for(uint32 W = 0; W < wordsPerRow; ++W)
+                {
+                    uint64 random = random_counter64(seed, counter + W);
+                    north[W] = random;
+                    west[W] = ~random;
+                }
+                north[0] |= 1;
+            }
+            west[0] &= ~1ULL;
+            north[wordsPerRow-1] &= tailMask;
+            west[wordsPerRow-1] &= tailMask;
+        }
+    });
+}
+
+void generate_sidewinder(WallBits &bits, uint64 seed)
+{
+    uint32 wordsPerRow = bits.wordsPerRow;
+    uint64 tailMask = wallBits_tailMask(bits.width);
+    uint64 runSeed = random_counter64(seed, 0x5157e);
+
+    parallel_forRows(bits.height, [&](uint32 firstRow, uint32 endRow)
+    {
+        for(uint32 X = firstRow;
+            X < endRow;
+            ++X)
+        {
+            uint64 *north = bits.north + (uint64)X*wordsPerRow;
+            uint64 *west = bits.west + (uint64)X*wordsPerRow;
+            uint64 row = (uint64)bits.firstRow + X;
+            uint64 counter = row*wordsPerRow;
+
+            if(row == 0)
+            {
+                for(uint32 W = 0; W < wordsPerRow; ++W)
+                {
+                    north[W] = 0;
+                    west[W] = ~0ULL;
+                }
+                west[0] &= ~1ULL;
+                west[wordsPerRow-1] &= tailMask;
+                continue;
+            }
+
+            // Carving east from Y opens the west side of Y+1
+            uint64 carry = 0;
+            for(uint32 W = 0; W < wordsPerRow; ++W)
+            {
+                uint64 east = random_counter64(seed, counter + W);
+                north[W] = 0;
+                west[W] = (east << 1) | carry;
+                carry = east >> 63;
+            }
+            west[0] &= ~1ULL;
+            west[wordsPerRow-1] &= tailMask;
+
+            // A run ends wherever the next cell is not opened west
+            uint32 runStart = 0;
+            for(uint32 W = 0; W < wordsPerRow; ++W)
+            {
+                uint64 nextWest = (W+1 < wordsPerRow) ? west[W+1] : 0;
+                uint64 runEnds = ~((west[W] >> 1) | (nextWest << 63));
+                if(W == wordsPerRow-1)
+                    runEnds &= tailMask;
+
+                while(runEnds)
+                {
+                    uint32 runEnd = W*64 + __builtin_ctzll(runEnds);
+                    runEnds &= runEnds - 1;
+
+                    uint64 runLength = runEnd - runStart + 1;
+                    uint64 random = random_counter64(runSeed, row*bits.width + runEnd);
+                    uint32 chosen = runStart + (uint32)(((random & 0xffffffff) * runLength) >> 32);
+                    north[chosen / 64] |= 1ULL << (chosen % 64);
+
+                    runStart = runEnd + 1;
+                }
+            }
+        }
+    });
+}
+
+void linkCells_fromWallBits(Maze &maze, WallBits &bits)
+{
+    parallel_forRows(maze.height, [&](uint32 firstRow, uint32 endRow)
+    {
+        for(uint32 X = firstRow;
+            X < endRow && !isCancelled();
+            ++X)
+        {
+            uint64 *north = bits.north + (uint64)X*bits.wordsPerRow;
+            uint64 *west = bits.west + (uint64)X*bits.wordsPerRow;
+            for(uint32 Y = 0;
+                Y < maze.width;
+                ++Y)
+            {
+                uint64 mask = 1ULL << (Y % 64);
+                if(north[Y / 64] & mask)
+                {
+                    maze.cells[X][Y].neighbours[0] = &maze.cells[X-1][Y];
+                    maze.cells[X-1][Y].neighbours[2] = &maze.cells[X][Y];
+                }
+                if(west[Y / 64] & mask)
+                {
+                    maze.cells[X][Y].neighbours[3] = &maze.cells[X][Y-1];
+                    maze.cells[X][Y-1].neighbours[1] = &maze.cells[X][Y];
+                }
+            }
+        }
+    });
+}
+
+// Every region is carved by its own worker, then a spanning tree over the
+// regions opens one wall per tree edge
+template<typename DirectionPolicy>
+void generate_parallelBacktrack(Maze &maze, DirectionPolicy &policy)
+{
+    uint32 regionColumns = (uint32)ceil(sqrt((double)workerCount));
+    uint32 regionRows = (workerCount + regionColumns - 1) / regionColumns;
+    if(regionRows > maze.height)
+        regionRows = maze.height;
+    if(regionColumns > maze.width)
+        regionColumns = maze.width;
+
+    uint32 regionCount = regionRows*regionColumns;
+    std::vector<Region> regions(regionCount);
+    for(uint32 R = 0; R < regionRows; ++R)
+    {
+        for(uint32 C = 0; C < regionColumns; ++C)
+        {
+            Region &region = regions[R*regionColumns + C];
+            region.min.X = (uint32)((uint64)maze.height*R / regionRows);
+            region.max.X = (uint32)((uint64)maze.height*(R+1) / regionRows);
+            region.min.Y = (uint32)((uint64)maze.width*C / regionColumns);
+            region.max.Y = (uint32)((uint64)maze.width*(C+1) / regionColumns);
+        }
+    }
+
+    parallel_forRows(regionCount, [&](uint32 firstRegion, uint32 endRegion)
+    {
+        for(uint32 R = firstRegion; R < endRegion; ++R)
+        {
+            std::mt19937 regionEngine((std::mt19937::result_type)random_counter64(maze.seed, R));
+            DirectionPolicy regionPolicy = policy;
+            regionPolicy.random.ownEngine = &regionEngine;
+            generate_recursiveBacktrack(maze, regionPolicy, regions[R]);
+        }
+    });
+
+    // Random spanning tree over the region lattice
+    std::vector<uint8> regionVisited(regionCount, 0);
+    std::stack<uint32> backtrack;
+    uint32 cursor = rand() % regionCount;
+    backtrack.push(cursor);
+    regionVisited[cursor] = 1;
+    while(!backtrack.empty())
+    {
+        uint32 R = cursor / regionColumns;
+        uint32 C = cursor % regionColumns;
+
+        bool unvisitedNeighbours = false;
+        if(R > 0)
+            unvisitedNeighbours |= !regionVisited[cursor - regionColumns];
+        if(C+1 < regionColumns)
+            unvisitedNeighbours |= !regionVisited[cursor + 1];
+        if(R+1 < regionRows)
+            unvisitedNeighbours |= !regionVisited[cursor + regionColumns];
+        if(C > 0)
+            unvisitedNeighbours |= !regionVisited[cursor - 1];
+
+        if(unvisitedNeighbours)
+        {
+            int direction = 0;
+            uint32 next = cursor;
+            bool valid = false;
+            while(!valid)
+            {
+                direction = rand() % 4;
+                switch(direction)
+                {
+                case 0:
+                    valid = (R > 0);
+                    next = cursor - regionColumns;
+                    break;
+                case 1:
+                    valid = (C+1 < regionColumns);
+                    next = cursor + 1;
+                    break;
+                case 2:
+                    valid = (R+1 < regionRows);
+                    next = cursor + regionColumns;
+                    break;
+                case 3:
+                    valid = (C > 0);
+                    next = cursor - 1;
+                    break;
+                }
+                valid = valid && !regionVisited[next];
+            }
+
+            // Open one wall at random along the shared border
+            Region &region = regions[cursor];
+            Coordinates inside = {}, outside = {};
+            if(direction == 0 || direction == 2)
+            {
+                inside.Y = region.min.Y + rand() % (region.max.Y - region.min.Y);
+                inside.X = (direction == 0) ? region.min.X : region.max.X - 1;
+                outside.Y = inside.Y;
+                outside.X = (direction == 0) ? inside.X - 1 : inside.X + 1;
+            }
+            else
+            {
+                inside.X = region.min.X + rand() % (region.max.X - region.min.X);
+                inside.Y = (direction == 3) ? region.min.Y : region.max.Y - 1;
+                outside.X = inside.X;
+                outside.Y = (direction == 3) ? inside.Y - 1 : inside.Y + 1;
+            }
+            maze.cells[inside.X][inside.Y].neighbours[direction] = &maze.cells[outside.X][outside.Y];
+            maze.cells[outside.X][outside.Y].neighbours[(direction+2)%4] = &maze.cells[inside.X][inside.Y];
+
+            backtrack.push(next);
+            regionVisited[next] = 1;
+            cursor = next;
+        }
+        else
+        {
+            backtrack.pop();
+            if(!backtrack.empty())
+                cursor = backtrack.top();
+        }
+    }
+
+    maze.start.X = rand() % maze.height;
+    maze.start.Y = rand() % maze.width;
+}
+
+void buildPolarMaze(PolarMaze &maze, uint32 rings)
+{
+    maze.rings = rings;
+    maze.ringSectors = (uint32 *)malloc(sizeof(uint32)*rings);
+    maze.ringOffsets = (uint32 *)malloc(sizeof(uint32)*(rings+1));
+
+    maze.ringSectors[0] = 1;
+    maze.ringOffsets[0] = 0;
+    for(uint32 R = 1; R < rings; ++R)
+    {
+        uint32 previousSectors = maze.ringSectors[R-1];
+        double cellWidth = 2.0*PI*R / previousSectors;
+        uint32 ratio = (uint32)round(cellWidth);
+        if(ratio < 1)
+            ratio = 1;
+
+        maze.ringSectors[R] = previousSectors*ratio;
+        maze.ringOffsets[R] = maze.ringOffsets[R-1] + previousSectors;
+    }
+    maze.ringOffsets[rings] = maze.ringOffsets[rings-1] + maze.ringSectors[rings-1];
+
+    uint32 cellCount = maze.ringOffsets[rings];
+    maze.cells = (PolarCell *)malloc(sizeof(PolarCell)*cellCount);
+    for(uint32 i = 0; i < cellCount; ++i)
+    {
+        PolarCell dummy = {};
+        maze.cells[i] = dummy;
+    }
+}
+
+void destroyPolarMaze(PolarMaze &maze)
+{
+    free(maze.ringSectors);
+    free(maze.ringOffsets);
+    free(maze.cells);
+}
+
+// 0 is inward, 1 clockwise, 2 outward and 3 counter clockwise
+inline uint32 polarMaze_ringOf(PolarMaze &maze, uint32 cell)
+{
+    uint32 *ringEnd = std::upper_bound(maze.ringOffsets, maze.ringOffsets + maze.rings + 1, cell);
+    return (uint32)(ringEnd - maze.ringOffsets) - 1;
+}
+
+template<typename DirectionPolicy>
+void generate_polarBacktrack(PolarMaze &maze, DirectionPolicy &randomDir)
+{
+    std::stack<uint32> backtrack;
+    uint32 cellCount = maze.ringOffsets[maze.rings];
+    uint32 cursor = rand() % cellCount;
+    uint32 ring = polarMaze_ringOf(maze, cursor);
+
+    maze.start = cursor;
+
+    backtrack.push(cursor);
+    maze.cells[cursor].visited++;
+    uint32 pendingCells = 1;
+    while(!backtrack.empty())
+    {
+        uint32 offset = maze.ringOffsets[ring];
+        uint32 sectors = maze.ringSectors[ring];
+        uint32 sector = cursor - offset;
+
+        uint32 inward = 0, outward = 0, outwardCount = 0;
+        uint32 clockwise = offset + (sector+1) % sectors;
+        uint32 counterClockwise = offset + (sector+sectors-1) % sectors;
+        if(ring > 0)
+        {
+            uint32 ratio = sectors / maze.ringSectors[ring-1];
+            inward = maze.ringOffsets[ring-1] + sector / ratio;
+        }
+        if(ring+1 < maze.rings)
+        {
+            outwardCount = maze.ringSectors[ring+1] / sectors;
+            outward = maze.ringOffsets[ring+1] + sector*outwardCount;
+        }
+
+        bool unvisitedNeighbours = false;
+        if(ring > 0)
+        {
+            unvisitedNeighbours |= !maze.cells[inward].visited;
+            unvisitedNeighbours |= !maze.cells[clockwise].visited;
+            unvisitedNeighbours |= !maze.cells[counterClockwise].visited;
+        }
+        for(uint32 i = 0; i < outwardCount; ++i)
+        {
+            unvisitedNeighbours |= !maze.cells[outward + i].visited;
+        }
+
+        if(unvisitedNeighbours)
+        {
+            uint32 next = cursor;
+            uint32 nextRing = ring;
+            int direction = 0;
+
+            while(next == cursor || maze.cells[next].visited)
+            {
+                direction = randomDir.next();
+                next = cursor;
+                nextRing = ring;
+
+                switch(direction)
+                {
+                case 0:
+                    if(ring > 0)
+                    {
+                        next = inward;
+                        nextRing = ring-1;
+                    }
+                    break;
+                case 1:
+                    if(ring > 0)
+                        next = clockwise;
+                    break;
+                case 2:
+                    if(outwardCount)
+                    {
+                        next = outward + rand() % outwardCount;
+                        nextRing = ring+1;
+                    }
+                    break;
+                case 3:
+                    if(ring > 0)
+                        next = counterClockwise;
+                    break;
+                }
+            }
+
+            switch(direction)
+            {
+            case 0:
+                maze.cells[cursor].openInward = 1;
+                break;
+            case 1:
+                maze.cells[cursor].openClockwise = 1;
+                break;
+            case 2:
+                maze.cells[next].openInward = 1;
+                break;
+            case 3:
+                maze.cells[next].openClockwise = 1;
+                break;
+            }
+
+            backtrack.push(next);
+            maze.cells[next].visited++;
+            randomDir.moved(direction);
+            cursor = next;
+            ring = nextRing;
+
+            if(++pendingCells == PROGRESS_BATCH)
+            {
+                pendingCells = 0;
+                if(progress_addCells(PROGRESS_BATCH))
+                    return;
+            }
+        }
+        else
+        {
+            backtrack.pop();
+            if(!backtrack.empty())
+                cursor = backtrack.top();
+            ring = polarMaze_ringOf(maze, cursor);
+        }
+    }
+
+    progress_addCells(pendingCells);
+}
+
+// Calls generator(policy) with the policy picked by -d
+template<typename Generator>
+void dispatch_directionPolicy(uint32 directionPolicy, Generator &generator)
+{
+    switch(directionPolicy)
+    {
+    case DIRECTION_RAND:
+    {
+        DirectionPolicy_Rand policy = {};
+        generator(policy);
+    } break;
+    case DIRECTION_WEIRD:
+    {
+        DirectionPolicy_Weird policy = {};
+        generator(policy);
+    } break;
+    case DIRECTION_HORIZONTAL:
+    {
+        DirectionPolicy_Horizontal<DIRECTION_BIAS_RANGE> policy = {};
+        generator(policy);
+    } break;
+    case DIRECTION_VERTICAL:
+    {
+        DirectionPolicy_Vertical<DIRECTION_BIAS_RANGE> policy = {};
+        generator(policy);
+    } break;
+    case DIRECTION_CHANGING:
+    {
+        DirectionPolicy_Changing policy = {};
+        policy.previousDirection = randomDir_uniform(policy.random);
+        generator(policy);
+    } break;
+    default:
+    {
+        DirectionPolicy_Uniform policy = {};
+        generator(policy);
+    } break;
+    }
+}
+
+struct PolarBacktrackGenerator
+{
+    PolarMaze &maze;
+
+    template<typename DirectionPolicy>
+    void operator()(DirectionPolicy &policy)
+    {
+        generate_polarBacktrack(maze, policy);
+    }
+};
+
+struct RecursiveBacktrackGenerator
+{
+    Maze &maze;
+
+    template<typename DirectionPolicy>
+    void operator()(DirectionPolicy &policy)
+    {
+        maze.start = generate_recursiveBacktrack(maze, policy, wholeMaze(maze));
+    }
+};
+
+struct ParallelBacktrackGenerator
+{
+    Maze &maze;
+
+    template<typename DirectionPolicy>
+    void operator()(DirectionPolicy &policy)
+    {
+        generate_parallelBacktrack(maze, policy);
+    }
+};
+
+template<typename Topology>
+void allocateMazeCells(MazeT<Topology> &maze)
+{
+    typedef CellT<Topology> Cell;
+    maze.cells = (Cell **)calloc(maze.height, sizeof(Cell*));
+
+    // Creating all of the cells with closed doors
+    for(uint32 X = 0;
+        X < maze.height && !isCancelled();
+        ++X)
+    {
+        maze.cells[X] = (Cell *)malloc(sizeof(Cell)*maze.width);
+        for(uint32 Y = 0;
+            Y < maze.width;
+            ++Y)
+        {
+            Cell dummy = {};
+            dummy.distFromStart = 0;
+            dummy.visited = 0;
+            dummy.position.X = X;
+            dummy.position.Y = Y;
+            for(int N = 0; N < Topology::NeighbourCount; ++N)
+            {
+                dummy.neighbours[N] = NULL;
+            }
+
+            maze.cells[X][Y] = dummy;
+        }
+    }
+}
+
+template<typename Topology>
+void buildTopologyMaze(MazeT<Topology> &maze)
+{
+    allocateMazeCells(maze);
+    if(isCancelled())
+        return;
+
+    DirectionPolicy_UniformN<Topology::NeighbourCount> policy = {};
+    maze.start = generate_recursiveBacktrack(maze, policy, wholeMaze(maze));
+    if(isCancelled())
+        return;
+
+    progress_setPhase(PHASE_DISTANCES);
+    process_distanceFromStart(maze);
+}
+
+void buildMaze(Maze &maze, uint32 algorithm, uint32 directionPolicy)
+{
+    allocateMazeCells(maze);
+    if(isCancelled())
+        return;
+
+    // Generate the maze
+    switch(algorithm)
+    {
+    case ALGORITHM_BINARY_TREE:
+    case ALGORITHM_SIDEWINDER:
+    {
+        WallBits bits = {};
+        buildWallBits(bits, maze.width, maze.height);
+        if(algorithm == ALGORITHM_BINARY_TREE)
+            generate_binaryTree(bits, maze.seed);
+        else
+            generate_sidewinder(bits, maze.seed);
+        linkCells_fromWallBits(maze, bits);
+        destroyWallBits(bits);
+
+        maze.start.X = rand() % maze.height;
+        maze.start.Y = rand() % maze.width;
+    } break;
+    case ALGORITHM_PARALLEL_BACKTRACK:
+    {
+        ParallelBacktrackGenerator generator = { maze };
+        dispatch_directionPolicy(directionPolicy, generator);
+    } break;
+    default:
+    {
+        RecursiveBacktrackGenerator generator = { maze };
+        dispatch_directionPolicy(directionPolicy, generator);
+    } break;
+    }
+
+    if(isCancelled())
+        return;
+
+    progress_setPhase(PHASE_DISTANCES);
+    process_distanceFromStart(maze);
+}
+
+template<typename Topology>
+void destroyMaze(MazeT<Topology> &maze)
+{
+    for(uint32 i = 0; i < maze.height; i++)
+    {
+        free(maze.cells[i]);
+    }
+    free(maze.cells);
+}
+
+inline uint32 cellDegree(Cell *cell)
+{
+    return (cell->neighbours[0] != NULL) + (cell->neighbours[1] != NULL) +
+           (cell->neighbours[2] != NULL) + (cell->neighbours[3] != NULL);
+}
+
+// Returns the distance of the farthest cell from origin
+uint32 process_farthestCell(Maze &maze, Coordinates origin,
+                            std::vector<uint32> &distances,
+                            Coordinates &farthest, Coordinates *target,
+                            uint32 *targetDistance)
+{
+    const uint32 UNREACHED = 0xffffffff;
+    std::fill(distances.begin(), distances.end(), UNREACHED);
+
+    std::queue<Cell *> frontier;
+    frontier.push(&maze.cells[origin.X][origin.Y]);
+    distances[(uint64)origin.X*maze.width + origin.Y] = 0;
+
+    uint32 maxDistance = 0;
+    uint32 pendingCells = 0;
+    farthest = origin;
+    while(!frontier.empty())
+    {
+        if(++pendingCells == PROGRESS_BATCH)
+        {
+            pendingCells = 0;
+            if(isCancelled())
+                break;
+        }
+
+        Cell *cursor = frontier.front();
+        frontier.pop();
+        uint32 distance = distances[(uint64)cursor->position.X*maze.width + cursor->position.Y];
+        if(distance > maxDistance)
+        {
+            maxDistance = distance;
+            farthest = cursor->position;
+        }
+
+        for(int i = 0; i < 4; ++i)
+        {
+            Cell *neighbour = cursor->neighbours[i];
+            if(neighbour != NULL)
+            {
+                uint32 &neighbourDistance =
+                    distances[(uint64)neighbour->position.X*maze.width + neighbour->position.Y];
+                if(neighbourDistance == UNREACHED)
+                {
+                    neighbourDistance = distance + 1;
+                    frontier.push(neighbour);
+                }
+            }
+        }
+    }
+
+    if(target)
+    {
+        *targetDistance = distances[(uint64)target->X*maze.width + target->Y];
+    }
+
+    return maxDistance;
+}
+
+// Corridors are walked from both ends, only the walk from the lower index
+// counts. The diameter comes from a double sweep.
+void process_mazeStats(Maze &maze, MazeStats &stats)
+{
+    std::mutex statsMutex;
+    for(int i = 0; i < 5; ++i)
+    {
+        stats.degreeCounts[i] = 0;
+    }
+    stats.corridorCount = 0;
+    stats.corridorLengths.clear();
+
+    parallel_forRows(maze.height, [&](uint32 firstRow, uint32 endRow)
+    {
+        uint64 degreeCounts[5] = {};
+        uint64 corridorCount = 0;
+        std::vector<uint64> corridorLengths;
+
+        for(uint32 X = firstRow;
+            X < endRow && !isCancelled();
+            ++X)
+        {
+            for(uint32 Y = 0;
+                Y < maze.width;
+                ++Y)
+            {
+                Cell *cell = &maze.cells[X][Y];
+                uint32 degree = cellDegree(cell);
+                degreeCounts[degree]++;
+                if(degree == 2)
+                    continue;
+
+                uint64 cellIndex = (uint64)X*maze.width + Y;
+                for(int i = 0; i < 4; ++i)
+                {
+                    Cell *previous = cell;
+                    Cell *cursor = cell->neighbours[i];
+                    if(cursor == NULL)
+                        continue;
+
+                    uint64 length = 1;
+                    while(cellDegree(cursor) == 2)
+                    {
+                        Cell *next = cursor->neighbours[0];
+                        for(int N = 0; next == NULL || next == previous; ++N)
+                        {
+                            next = cursor->neighbours[N];
+                        }
+                        previous = cursor;
+                        cursor = next;
+                        length++;
+                    }
+
+                    uint64 endIndex = (uint64)cursor->position.X*maze.width + cursor->position.Y;
+                    if(cellIndex < endIndex)
+                    {
+                        if(corridorLengths.size() <= length)
+                            corridorLengths.resize(length+1, 0);
+                        corridorLengths[length]++;
+                        corridorCount++;
+                    }
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        for(int i = 0; i < 5; ++i)
+        {
+            stats.degreeCounts[i] += degreeCounts[i];
+        }
+        stats.corridorCount += corridorCount;
+        if(stats.corridorLengths.size() < corridorLengths.size())
+            stats.corridorLengths.resize(corridorLengths.size(), 0);
+        for(uint32 i = 0; i < corridorLengths.size(); ++i)
+        {
+            stats.corridorLengths[i] += corridorLengths[i];
+        }
+    });
+    if(isCancelled())
+        return;
+
+    std::vector<uint32> distances((uint64)maze.width*maze.height);
+    Coordinates topLeft = {};
+    Coordinates bottomRight = {};
+    bottomRight.X = maze.height-1;
+    bottomRight.Y = maze.width-1;
+
+    process_farthestCell(maze, topLeft, distances, stats.diameterStart,
+                         &bottomRight, &stats.solutionLength);
+    if(isCancelled())
+        return;
+    stats.diameter = process_farthestCell(maze, stats.diameterStart, distances,
+                                          stats.diameterEnd, NULL, NULL);
+}
+
+void writeMazeStats(FILE *file, Maze &maze, MazeStats &stats)
+{
+    fprintf(file, "{\n");
+    fprintf(file, "    \"width\": %u,\n", maze.width);
+    fprintf(file, "    \"height\": %u,\n", maze.height);
+    fprintf(file, "    \"seed\": %llu,\n", (unsigned long long)maze.seed);
+    fprintf(file, "    \"cells\": %llu,\n", (unsigned long long)maze.width*maze.height);
+    fprintf(file, "    \"deadEnds\": %llu,\n", (unsigned long long)stats.degreeCounts[1]);
+    fprintf(file, "    \"junctions\": { \"three\": %llu, \"four\": %llu },\n",
+            (unsigned long long)stats.degreeCounts[3],
+            (unsigned long long)stats.degreeCounts[4]);
+    fprintf(file, "    \"corridors\": %llu,\n", (unsigned long long)stats.corridorCount);
+    fprintf(file, "    \"corridorLengths\": {");
+    bool first = true;
+    for(uint32 i = 0; i < stats.corridorLengths.size(); ++i)
+    {
+        if(stats.corridorLengths[i])
+        {
+            fprintf(file, "%s \"%u\": %llu", first ? "" : ",", i,
+                    (unsigned long long)stats.corridorLengths[i]);
+            first = false;
+        }
+    }
+    fprintf(file, " },\n");
+    fprintf(file, "    \"solution\": { \"from\": [0, 0], \"to\": [%u, %u], \"length\": %u },\n",
+            maze.height-1, maze.width-1, stats.solutionLength);
+    fprintf(file, "    \"diameter\": { \"from\": [%u, %u], \"to\": [%u, %u], \"length\": %u }\n",
+            stats.diameterStart.X, stats.diameterStart.Y,
+            stats.diameterEnd.X, stats.diameterEnd.Y,
+            stats.diameter);
+    fprintf(file, "}\n");
+}
+
+inline void SDL_DrawSpan(SDL_Surface *surface, int X, int firstY, int lastY, uint32 colour)
+{
+    if(X < 0 || X >= surface->h)
+        return;
+    if(firstY > lastY)
+    {
+        int swap = firstY;
+        firstY = lastY;
+        lastY = swap;
+    }
+    if(firstY < 0)
+        firstY = 0;
+    if(lastY >= surface->w)
+        lastY = surface->w - 1;
+
+    uint32 *pixel = (uint32 *)((uint8 *)surface->pixels + (int64)surface->pitch*X) + firstY;
+    for(int Y = firstY; Y <= lastY; ++Y)
+    {
+        *pixel++ = colour;
+    }
+}
+
+// Outline of a circle as runs of pixels by increasing angle, each run tagged
+// with its sector
+void buildArcSpans(int R, const float *cosines, const float *sines,
+                   uint32 sectorCount, std::vector<ArcSpan> &spans)
+{
+    spans.clear();
+    if(R <= 0)
+        return;
+
+    std::vector<int> rowExtent(R+2);
+    double outerRadius = R + 0.5;
+    for(int row = 0; row <= R; ++row)
+    {
+        rowExtent[row] = (int)floor(sqrt(outerRadius*outerRadius - (double)row*row));
+    }
+    rowExtent[R+1] = -1;
+
+    uint32 sector = 0;
+    ArcSpan current = {};
+    bool open = false;
+
+    auto visit = [&](int X, int Y)
+    {
+        while(sector+1 < sectorCount &&
+              cosines[sector+1]*X - sines[sector+1]*Y >= 0.0f)
+        {
+            sector++;
+        }
+
+        if(open && current.row == X && current.sector == sector &&
+           (Y == current.firstColumn-1 || Y == current.lastColumn+1))
+        {
+            if(Y < current.firstColumn)
+                current.firstColumn = Y;
+            else
+                current.lastColumn = Y;
+        }
+        else
+        {
+            if(open)
+                spans.push_back(current);
+            current.row = X;
+            current.firstColumn = Y;
+            current.lastColumn = Y;
+            current.sector = sector;
+            open = true;
+        }
+    };
+
+    // Quadrant by quadrant, walking the rows so the angle keeps growing
+    for(int quadrant = 0; quadrant < 4; ++quadrant)
+    {
+        bool outwardRows = (quadrant % 2) == 0;
+        int rowSign = (quadrant < 2) ? 1 : -1;
+        int columnSign = (quadrant == 0 || quadrant == 3) ? 1 : -1;
+
+        for(int i = 0; i <= R; ++i)
+        {
+            int row = outwardRows ? i : R - i;
+            int farColumn = rowExtent[row];
+            int nearColumn = rowExtent[row+1] + 1;
+            if(nearColumn > farColumn)
+                nearColumn = farColumn;
+
+            if(outwardRows)
+            {
+                for(int column = farColumn; column >= nearColumn; --column)
+                    visit(rowSign*row, columnSign*column);
+            }
+            else
+            {
+                for(int column = nearColumn; column <= farColumn; ++column)
+                    visit(rowSign*row, columnSign*column);
+            }
+        }
+    }
+    if(open)
+        spans.push_back(current);
+}
+
+void SDL_DrawCircle(SDL_Surface *surface, Coordinates &center, int R, uint32 colour)
+{
+    float cosine = 1.0f;
+    float sine = 0.0f;
+    std::vector<ArcSpan> spans;
+    buildArcSpans(R, &cosine, &sine, 1, spans);
+
+    for(uint32 i = 0; i < spans.size(); ++i)
+    {
+        SDL_DrawSpan(surface,
+                     (int)center.X + spans[i].row,
+                     (int)center.Y + spans[i].firstColumn,
+                     (int)center.Y + spans[i].lastColumn,
+                     colour);
+    }
+}
+
+void SDL_DrawLine(SDL_Surface *surface, Coordinates A, Coordinates B, uint32 colour)
+{
+    int X = A.X;
+    int Y = A.Y;
+    int W = (int)B.X - (int)A.X;
+    int H = (int)B.Y - (int)A.Y;
+    int dX1 = 0-(W<0)+(W>0);
+    int dX2 = dX1;
+    int dY1 = 0-(H<0)+(H>0);
+    int dY2 = 0;
+
+    int longest = abs(W);
+    int shortest = abs(H);
+    if(longest < shortest)
+    {
+        longest = abs(H);
+        shortest = abs(W);
+        dY2 = 0-(H<0)+(H>0);
+        dX2 = 0;
+    }
+
+    int spanRow = X;
+    int spanStart = Y;
+    int numerator = longest/2;
+    for(int i = 0; i < longest; i++)
+    {
+        int previousY = Y;
+        numerator += shortest;
+        if(numerator>longest)
+        {
+            numerator -= longest;
+            X += dX1;
+            Y += dY1;
+        }
+        else
+        {
+            X += dX2;
+            Y += dY2;
+        }
+
+        if(X != spanRow)
+        {
+            SDL_DrawSpan(surface, spanRow, spanStart, previousY, colour);
+            spanRow = X;
+            spanStart = Y;
+        }
+    }
+    SDL_DrawSpan(surface, spanRow, spanStart, Y, colour);
+}
+
+void SDL_DrawOrientedLine(SDL_Surface *surface,
+                          Coordinates O,
+                          float sine,
+                          float cosine,
+                          int start,
+                          int length,
+                          uint32 colour)
+{
+    Coordinates A = {}, B = {};
+
+    A.X = O.X + round(sine*start);
+    A.Y = O.Y + round(cosine*start);
+    B.X = O.X + round(sine*(start+length));
+    B.Y = O.Y + round(cosine*(start+length));
+
+    SDL_DrawLine(surface, A, B, colour);
+}
+
+void renderWallBits_Walls(SDL_Surface *buffer, WallBits &bits)
+{
+    uint32 BLACK = 0x00000000;
+    uint32 WHITE = 0xffffffff;
+
+    parallel_forRows(bits.height, [&](uint32 firstRow, uint32 endRow)
+    {
+        for(uint32 X = firstRow;
+            X < endRow;
+            ++X)
+        {
+            uint64 *north = bits.north + (uint64)X*bits.wordsPerRow;
+            uint64 *west = bits.west + (uint64)X*bits.wordsPerRow;
+            uint32 *pixel = (uint32 *)((uint8 *)buffer->pixels + (int64)buffer->pitch*2*X);
+            uint32 *nextPixel = (uint32 *)((uint8 *)pixel + buffer->pitch);
+            for(uint32 Y = 0;
+                Y < bits.width;
+                ++Y)
+            {
+                uint64 mask = 1ULL << (Y % 64);
+                *pixel++ = BLACK;
+                *pixel++ = (north[Y / 64] & mask) ? WHITE : BLACK;
+                *nextPixel++ = (west[Y / 64] & mask) ? WHITE : BLACK;
+                *nextPixel++ = WHITE;
+            }
+            *pixel++ = BLACK;
+            *nextPixel++ = BLACK;
+
+            if(progress_addRows(2))
+                return;
+        }
+    });
+}
+
+// Fixed size mazes up to 64 cells wide, one WallBits word per row and no
+// allocation
+template<uint32 Width, uint32 Height>
+struct SmallMaze
+{
+    uint64 north[Height];
+    uint64 west[Height];
+};
+
+// Direction of the n-th set bit of a 4 bit direction mask
+static const uint8 smallMaze_nthDirection[16][4] =
+{
+    {0, 0, 0, 0}, {0, 0, 0, 0}, {1, 0, 0, 0}, {0, 1, 0, 0},
+    {2, 0, 0, 0}, {0, 2, 0, 0}, {1, 2, 0, 0}, {0, 1, 2, 0},
+    {3, 0, 0, 0}, {0, 3, 0, 0}, {1, 3, 0, 0}, {0, 1, 3, 0},
+    {2, 3, 0, 0}, {0, 2, 3, 0}, {1, 2, 3, 0}, {0, 1, 2, 3},
+};
+
+template<uint32 Width>
+inline uint32 smallMaze_stepOffset(uint32 direction)
+{
+    static const int32 offsets[4] = { -(int32)Width, 1, (int32)Width, -1 };
+    return (uint32)offsets[direction];
+}
+
+// The sentinel rows and columns of the bitboard make the borders read as
+// visited
+template<uint32 Width, uint32 Height>
+void generate_smallMaze(SmallMaze<Width, Height> &maze, uint64 seed)
+{
+    static_assert(Width >= 1 && Width <= 64, "A row has to fit in one word");
+    static_assert(Width*Height <= 65536, "Cell indices have to fit in 16 bits");
+
+    uint64 visited[Height + 2];
+    visited[0] = ~0ULL;
+    visited[Height + 1] = ~0ULL;
+    for(uint32 X = 0; X < Height; ++X)
+    {
+        visited[X + 1] = ~wallBits_tailMask(Width);
+        maze.north[X] = 0;
+        maze.west[X] = 0;
+    }
+
+    uint16 backtrack[Width*Height];
+    uint32 backtrackSize = 0;
+
+    uint64 counter = 0;
+    uint64 random = random_counter64(seed, counter++);
+    uint32 randomBits = 64;
+
+    uint32 cursor = (uint32)(((random & 0xffff)*(Width*Height)) >> 16);
+    random >>= 16;
+    randomBits -= 16;
+
+    visited[cursor / Width + 1] |= 1ULL << (cursor % Width);
+    backtrack[backtrackSize++] = (uint16)cursor;
+    while(backtrackSize > 0)
+    {
+        uint32 X = cursor / Width;
+        uint32 Y = cursor % Width;
+        uint64 row = visited[X + 1];
+        uint32 blocked = (uint32)((visited[X] >> Y) & 1) |
+                         ((uint32)((((row >> 1) | (1ULL << 63)) >> Y) & 1) << 1) |
+                         ((uint32)((visited[X + 2] >> Y) & 1) << 2) |
+                         ((uint32)((((row << 1) | 1) >> Y) & 1) << 3);
+        uint32 unvisited = ~blocked & 0xf;
+
+        if(unvisited)
+        {
+            if(randomBits < 16)
+            {
+                random = random_counter64(seed, counter++);
+                randomBits = 64;
+            }
+            uint32 choice = (uint32)(((random & 0xffff)*__builtin_popcount(unvisited)) >> 16);
+            random >>= 16;
+            randomBits -= 16;
+            uint32 direction = smallMaze_nthDirection[unvisited][choice];
+
+            uint64 *walls = (direction & 1) ? maze.west : maze.north;
+            walls[X + (direction == 2)] |= 1ULL << (Y + (direction == 1));
+            uint32 next = cursor + smallMaze_stepOffset<Width>(direction);
+
+            visited[next / Width + 1] |= 1ULL << (next % Width);
+            backtrack[backtrackSize++] = (uint16)next;
+            cursor = next;
+        }
+        else
+        {
+            backtrackSize--;
+            if(backtrackSize > 0)
+            {
+                cursor = backtrack[backtrackSize - 1];
+            }
+        }
+    }
+}
+
+template<typename Job>
+bool dispatch_smallMazeSize(uint32 width, uint32 height, Job &job)
+{
+    if(width != height)
+    {
+        return false;
+    }
+
+    switch(width)
+    {
+    case 16: job.template run<16, 16>(); return true;
+    case 24: job.template run<24, 24>(); return true;
+    case 32: job.template run<32, 32>(); return true;
+    case 48: job.template run<48, 48>(); return true;
+    case 64: job.template run<64, 64>(); return true;
+    }
+
+    return false;
+}
+
+inline uint32 polarMaze_imageSize(uint32 rings)
+{
+    return 2*rings*POLAR_RING_HEIGHT + 3;
+}
+
+void renderPolarMaze_Walls(SDL_Surface *buffer, PolarMaze &maze)
+{
+    uint32 BLACK = 0x00000000;
+    uint32 WHITE = 0xffffffff;
+
+    for(int X = 0; X < buffer->h && !isCancelled(); ++X)
+    {
+        SDL_DrawSpan(buffer, X, 0, buffer->w - 1, WHITE);
+    }
+
+    uint32 cellCount = maze.ringOffsets[maze.rings];
+    std::vector<float> cosines(cellCount);
+    std::vector<float> sines(cellCount);
+    for(uint32 R = 0; R < maze.rings; ++R)
+    {
+        uint32 sectors = maze.ringSectors[R];
+        for(uint32 S = 0; S < sectors; ++S)
+        {
+            double angle = 2.0*PI*S / sectors;
+            cosines[maze.ringOffsets[R] + S] = (float)cos(angle);
+            sines[maze.ringOffsets[R] + S] = (float)sin(angle);
+        }
+    }
+
+    Coordinates center = {};
+    center.X = maze.rings*POLAR_RING_HEIGHT + 1;
+    center.Y = center.X;
+
+    std::vector<ArcSpan> spans;
+    for(uint32 R = 1; R < maze.rings; ++R)
+    {
+        if(isCancelled())
+            return;
+
+        uint32 offset = maze.ringOffsets[R];
+        uint32 sectors = maze.ringSectors[R];
+        int radius = R*POLAR_RING_HEIGHT;
+
+        // Inner arc of every cell of the ring
+        buildArcSpans(radius, &cosines[offset], &sines[offset], sectors, spans);
+        for(uint32 i = 0; i < spans.size(); ++i)
+        {
+            if(!maze.cells[offset + spans[i].sector].openInward)
+            {
+                SDL_DrawSpan(buffer,
+                             (int)center.X + spans[i].row,
+                             (int)center.Y + spans[i].firstColumn,
+                             (int)center.Y + spans[i].lastColumn,
+                             BLACK);
+            }
+        }
+
+        // Radial wall on the counter clockwise side of every cell
+        for(uint32 S = 0; S < sectors; ++S)
+        {
+            uint32 counterClockwise = offset + (S+sectors-1) % sectors;
+            if(!maze.cells[counterClockwise].openClockwise)
+            {
+                SDL_DrawOrientedLine(buffer, center,
+                                     sines[offset + S], cosines[offset + S],
+                                     radius, POLAR_RING_HEIGHT, BLACK);
+            }
+        }
+    }
+
+    SDL_DrawCircle(buffer, center, maze.rings*POLAR_RING_HEIGHT, BLACK);
+}
+
+uint32 process_linearInterpolation(uint32 value, uint32 maxValue,
+                                  RGBcolor* startColor, RGBcolor* maxColor)
+{ 
+        double coeff = (double)value/ (double)maxValue;
+        uint8 R = (startColor->red + 
+                  (uint8)(coeff * (maxColor->red - startColor->red)))%256;
+        uint8 G = (startColor->green + 
+                  (uint8)(coeff * (maxColor->green - startColor->green)))%256;
+        uint8 B = (startColor->blue + 
+                  (uint8)(coeff * (maxColor->blue - startColor->blue)))%256;
+
+        uint32 COLOUR = ((R << 24) | (G << 16) | (B << 8));
+        return COLOUR;
+}
+
+inline uint32 process_twoGradients(uint32 distanceFromStart, uint32 maxDistance,
+                                   RGBcolor *colors, uint32 gradiantThreshold)
+{
+    RGBcolor* startColor;
+    RGBcolor* maxColor;
+
+    double coeff = 0.0f;
+    if(distanceFromStart < gradiantThreshold)
+    {
+        coeff = (double)distanceFromStart / 
+                (double)gradiantThreshold;
+        startColor = colors;
+        maxColor = colors + 1;
+    }
+    else
+    {
+        coeff = (double)(distanceFromStart - gradiantThreshold) / 
+                (double)(maxDistance - gradiantThreshold);
+        startColor = colors + 2;
+        maxColor = colors + 3;
+    }
+
+    RGBcolor cellColor;
+    cellColor.red = (startColor->red +
+                     (uint8)(coeff * (maxColor->red - startColor->red)))%256;
+    cellColor.green = (startColor->green +
+                       (uint8)(coeff * (maxColor->green - startColor->green)))%256;
+    cellColor.blue = (startColor->blue +
+                      (uint8)(coeff * (maxColor->blue - startColor->blue)))%256;
+
+    return ((cellColor.red << 24) | (cellColor.green << 16) | (cellColor.blue << 8));
+}
+
+inline uint32 process_nGradients(uint32 distanceFromStart, RGBcolor *colors,
+                                 uint32 segmentLength)
+{
+    uint32 segmentNumber = distanceFromStart / segmentLength;
+
+    uint32 normalisedValue = distanceFromStart % segmentLength;
+    uint32 maxValue = segmentLength;
+
+    RGBcolor* startColor = colors + 2*segmentNumber;
+    RGBcolor* maxColor = colors + 2*segmentNumber + 1;
+
+    return process_linearInterpolation(normalisedValue,
+                                       maxValue,
+                                       startColor,
+                                       maxColor);
+}
+
+template<typename Topology>
+void renderMaze_Shaded(SDL_Surface *buffer, 
+                       MazeT<Topology> &maze, RGBcolor startColor, RGBcolor maxColor)
+{
+    uint32 maxDistance = maze.maxDistance;
+
+    uint8 *row = (uint8 *)buffer->pixels;
+    for(uint32 X = 0;
+        X < maze.height;
+        ++X)
+    {
+        uint32 *pixel = (uint32 *)row;
+        for(uint32 Y = 0;
+            Y < maze.width;
+            ++Y)
+        {
+            *pixel++ = process_linearInterpolation(maze.cells[X][Y].distFromStart,
+                                                   maxDistance,
+                                                   &startColor,
+                                                   &maxColor);
+        }
+        row += buffer->pitch;
+
+        if(progress_addRows(1))
+            break;
+    }
+}
+
+template<typename Topology>
+void renderMaze_TwoShaded(SDL_Surface *buffer, 
+                          MazeT<Topology> &maze, 
+                          RGBcolor colors[4], 
+                          uint32 gradiantThreshold)
+{
+    uint32 maxDistance = maze.maxDistance;
+
+    uint8 *row = (uint8 *)buffer->pixels;
+    for(uint32 X = 0;
+        X < maze.height;
+        ++X)
+    {
+        uint32 *pixel = (uint32 *)row;
+        for(uint32 Y = 0;
+            Y < maze.width;
+            ++Y)
+        {
+            *pixel++ = process_twoGradients(maze.cells[X][Y].distFromStart,
+                                            maxDistance,
+                                            colors,
+                                            gradiantThreshold);
+        }
+        row += buffer->pitch;
+
+        if(progress_addRows(1))
+            break;
+    }
+}
+
+template<typename Topology>
+void render_nShaded(SDL_Surface* buffer, MazeT<Topology>& maze,
+                    RGBcolor* colors, uint32 colorCount)
+{
+    uint32 maxDistance = maze.maxDistance;
+    uint32 segmentCount = colorCount / 2;
+    uint32 segmentLength = maxDistance / segmentCount;
+
+    uint8 *row = (uint8 *)buffer->pixels;
+    for(uint32 X = 0;
+        X < maze.height;
+        ++X)
+    {
+        uint32 *pixel = (uint32 *)row;
+        for(uint32 Y = 0;
+            Y < maze.width;
+            ++Y)
+        {
+            *pixel++ = process_nGradients(maze.cells[X][Y].distFromStart,
+                                          colors,
+                                          segmentLength);
+        }
+        row += buffer->pitch;
+
+        if(progress_addRows(1))
+            break;
+    }
+}
+
+template<typename Topology>
+void renderMaze_ShadedColors(SDL_Surface *buffer, MazeT<Topology> &maze,
+                             RGBcolor *colors, uint32 colorCount)
+{
+    switch(colorCount)
+    {
+        case 0:
+            break;
+        case 1:
+        case 2:
+        {
+            renderMaze_Shaded(buffer, maze, colors[0], colors[1]);
+        } break;
+        case 3:
+        case 4:
+        {
+            renderMaze_TwoShaded(buffer,
+                                 maze,
+                                 colors,
+                                 maze.maxDistance / 2);
+        } break;
+        default:
+        {
+            render_nShaded(buffer,
+                           maze,
+                           colors,
+                           colorCount);
+        }
+    }
+}
+
+template<typename Topology>
+void renderTopologyMaze(SDL_Surface *buffer, Maze &shape,
+                        RGBcolor *colors, uint32 colorCount)
+{
+    MazeT<Topology> maze = {};
+    maze.width = shape.width;
+    maze.height = shape.height;
+    maze.depth = shape.depth;
+    maze.layerHeight = shape.height / shape.depth;
+    maze.seed = shape.seed;
+
+    progress_setPhase(PHASE_GENERATING);
+    buildTopologyMaze(maze);
+    if(!isCancelled())
+    {
+        progress_setPhase(PHASE_RENDERING);
+        renderMaze_ShadedColors(buffer, maze, colors, colorCount);
+    }
+    destroyMaze(maze);
+}
+
+inline uint32 process_gradientLength(uint32 maxDistance, uint32 colorCount)
+{
+    if(colorCount <= 2)
+        return maxDistance;
+    if(colorCount <= 4)
+        return maxDistance / 2;
+    return maxDistance / (colorCount / 2);
+}
+
+inline uint32 process_cellShade(uint32 distanceFromStart, uint32 maxDistance, uint32 gradientLength,
+                                RGBcolor *colors, uint32 colorCount)
+{
+    switch(colorCount)
+    {
+        case 0:
+            return 0;
+        case 1:
+        case 2:
+            return process_linearInterpolation(distanceFromStart, maxDistance,
+                                               &colors[0], &colors[1]);
+        case 3:
+        case 4:
+            return process_twoGradients(distanceFromStart, maxDistance,
+                                        colors, gradientLength);
+        default:
+            return process_nGradients(distanceFromStart, colors, gradientLength);
+    }
+}
+
+// Progress rows are counted on the first output of the pass
+struct RenderOutput
+{
+    uint32 kind;
+    SDL_Surface *surface;
+
+    // Thumbnail only
+    uint32 scale;
+    uint64 *sums;
+};
+
+inline const char *renderOutput_name(uint32 kind)
+{
+    static const char *outputNames[] = { "walls", "wallsshaded", "shaded", "thumbnail" };
+    return outputNames[kind];
+}
+
+void renderOutput_size(uint32 kind, Maze &maze, uint32 &width, uint32 &height, uint32 &scale)
+{
+    scale = 1;
+    width = maze.width;
+    height = maze.height;
+    if(kind == OUTPUT_WALLS || kind == OUTPUT_WALLS_SHADED)
+    {
+        width = maze.width*2 + 1;
+        height = maze.height*2 + 1;
+    }
+    else if(kind == OUTPUT_THUMBNAIL)
+    {
+        uint32 longestSide = (maze.width > maze.height) ? maze.width : maze.height;
+        scale = (longestSide + THUMBNAIL_SIZE - 1) / THUMBNAIL_SIZE;
+        if(scale == 0)
+        {
+            scale = 1;
+        }
+        width = (maze.width + scale - 1) / scale;
+        height = (maze.height + scale - 1) / scale;
+    }
+}
+
+void renderRow_Walls(SDL_Surface *buffer, uint32 X, uint32 width,
+                     uint8 *openings, uint32 *shades)
+{
+    uint32 BLACK = 0x00000000;
+    uint32 WHITE = 0xffffffff;
+
+    uint8 *row = (uint8 *)buffer->pixels + (int64)buffer->pitch*(2*X);
+    uint32 *pixel = (uint32 *)row;
+    uint32 *nextPixel = (uint32 *)(row + buffer->pitch);
+    for(uint32 Y = 0;
+        Y < width;
+        ++Y)
+    {
+        uint32 COLOUR = shades ? shades[Y] : WHITE;
+
+        *pixel++ = BLACK;
+        *pixel++ = (openings[Y] & (1 << 0)) ? COLOUR : BLACK;
+        *nextPixel++ = (openings[Y] & (1 << 3)) ? COLOUR : BLACK;
+        *nextPixel++ = COLOUR;
+    }
+    *pixel++ = BLACK;
+    *nextPixel++ = (openings[width-1] & (1 << 1)) ? (shades ? shades[width-1] : WHITE) : BLACK;
+}
+
+void renderRow_Shaded(SDL_Surface *buffer, uint32 X, uint32 width, uint32 *shades)
+{
+    uint32 *pixel = (uint32 *)((uint8 *)buffer->pixels + (int64)buffer->pitch*X);
+    memcpy(pixel, shades, sizeof(uint32)*width);
+}
+
+void renderRow_Thumbnail(RenderOutput &output, uint32 X, uint32 width,
+                         uint32 height, uint32 *shades)
+{
+    uint64 *sums = output.sums;
+    for(uint32 Y = 0;
+        Y < width;
+        ++Y)
+    {
+        uint64 *sum = sums + 3*(Y / output.scale);
+        sum[0] += (shades[Y] >> 24) & 0xff;
+        sum[1] += (shades[Y] >> 16) & 0xff;
+        sum[2] += (shades[Y] >> 8) & 0xff;
+    }
+
+    bool lastRowOfBlock = ((X + 1) % output.scale == 0) || (X + 1 == height);
+    if(!lastRowOfBlock)
+    {
+        return;
+    }
+
+    SDL_Surface *buffer = output.surface;
+    uint32 blockHeight = X % output.scale + 1;
+    uint32 *pixel = (uint32 *)((uint8 *)buffer->pixels +
+                               (int64)buffer->pitch*(X / output.scale));
+    for(uint32 column = 0;
+        column < (uint32)buffer->w;
+        ++column)
+    {
+        uint32 blockWidth = output.scale;
+        if((column + 1)*output.scale > width)
+        {
+            blockWidth = width - column*output.scale;
+        }
+        uint64 cellCount = (uint64)blockWidth*blockHeight;
+        uint64 *sum = sums + 3*column;
+
+        uint32 R = (uint32)(sum[0] / cellCount);
+        uint32 G = (uint32)(sum[1] / cellCount);
+        uint32 B = (uint32)(sum[2] / cellCount);
+        *pixel++ = ((R << 24) | (G << 16) | (B << 8));
+
+        sum[0] = sum[1] = sum[2] = 0;
+    }
+}
+
+// Every row of cells is read once for all of the outputs
+void renderMaze_Outputs(Maze &maze, RenderOutput *outputs, uint32 outputCount,
+                        RGBcolor *colors, uint32 colorCount)
+{
+    bool needShades = false;
+    bool needWallShades = false;
+    for(uint32 i = 0; i < outputCount; ++i)
+    {
+        if(outputs[i].kind == OUTPUT_SHADED || outputs[i].kind == OUTPUT_THUMBNAIL)
+        {
+            needShades = true;
+        }
+        else if(outputs[i].kind == OUTPUT_WALLS_SHADED)
+        {
+            needWallShades = true;
+        }
+
+        if(outputs[i].kind == OUTPUT_THUMBNAIL)
+        {
+            outputs[i].sums = (uint64 *)calloc(3*(uint64)outputs[i].surface->w, sizeof(uint64));
+        }
+    }
+
+    uint32 progressRows = 1;
+    if(outputs[0].kind == OUTPUT_WALLS || outputs[0].kind == OUTPUT_WALLS_SHADED)
+    {
+        progressRows = 2;
+    }
+
+    uint32 maxDistance = maze.maxDistance;
+    uint32 gradientLength = process_gradientLength(maxDistance, colorCount);
+
+    uint8 *openings = (uint8 *)malloc(maze.width);
+    uint32 *shades = (uint32 *)malloc(sizeof(uint32)*maze.width);
+    uint32 *wallShades = (uint32 *)malloc(sizeof(uint32)*maze.width);
+    for(uint32 X = 0;
+        X < maze.height;
+        ++X)
+    {
+        Cell *row = maze.cells[X];
+        for(uint32 Y = 0;
+            Y < maze.width;
+            ++Y)
+        {
+            Cell &cell = row[Y];
+            openings[Y] = (uint8)(((cell.neighbours[0] != NULL) << 0) |
+                                  ((cell.neighbours[1] != NULL) << 1) |
+                                  ((cell.neighbours[3] != NULL) << 3));
+
+            uint32 distanceFromStart = cell.distFromStart;
+            if(needWallShades)
+            {
+                wallShades[Y] = process_linearInterpolation(distanceFromStart, maxDistance,
+                                                            &colors[0], &colors[1]);
+            }
+            if(needShades)
+            {
+                shades[Y] = process_cellShade(distanceFromStart, maxDistance, gradientLength,
+                                              colors, colorCount);
+            }
+        }
+
+        for(uint32 i = 0; i < outputCount; ++i)
+        {
+            switch(outputs[i].kind)
+            {
+                case OUTPUT_WALLS:
+                {
+                    renderRow_Walls(outputs[i].surface, X, maze.width, openings, NULL);
+                } break;
+                case OUTPUT_WALLS_SHADED:
+                {
+                    renderRow_Walls(outputs[i].surface, X, maze.width, openings, wallShades);
+                } break;
+                case OUTPUT_SHADED:
+                {
+                    renderRow_Shaded(outputs[i].surface, X, maze.width, shades);
+                } break;
+                case OUTPUT_THUMBNAIL:
+                {
+                    renderRow_Thumbnail(outputs[i], X, maze.width, maze.height, shades);
+                } break;
+            }
+        }
+
+        if(progress_addRows(progressRows))
+            break;
+    }
+    free(wallShades);
+    free(shades);
+    free(openings);
+
+    for(uint32 i = 0; i < outputCount; ++i)
+    {
+        free(outputs[i].sums);
+        outputs[i].sums = NULL;
+    }
+}
+
+// Window over the saved image, zoom is in screen pixels per image pixel
+struct MazeView
+{
+    int32 width;
+    int32 height;
+    double centerX;
+    double centerY;
+    double zoom;
+    double minZoom;
+};
+
+inline void mazeView_imageSize(Maze &maze, uint32 kind, uint64 &imageWidth, uint64 &imageHeight)
+{
+    imageWidth = maze.width;
+    imageHeight = maze.height;
+    if(kind != OUTPUT_SHADED)
+    {
+        imageWidth = 2*(uint64)maze.width + 1;
+        imageHeight = 2*(uint64)maze.height + 1;
+    }
+}
+
+void mazeView_fit(MazeView &view, Maze &maze, uint32 kind)
+{
+    uint64 imageWidth, imageHeight;
+    mazeView_imageSize(maze, kind, imageWidth, imageHeight);
+
+    double zoomX = (double)view.height / imageHeight;
+    double zoomY = (double)view.width / imageWidth;
+    view.zoom = (zoomX < zoomY) ? zoomX : zoomY;
+    view.minZoom = view.zoom / 2;
+    view.centerX = imageHeight / 2.0;
+    view.centerY = imageWidth / 2.0;
+}
+
+void mazeView_zoom(MazeView &view, double factor, int32 screenX, int32 screenY)
+{
+    double zoom = view.zoom*factor;
+    if(zoom < view.minZoom)
+    {
+        zoom = view.minZoom;
+    }
+    if(zoom > VIEW_MAX_ZOOM)
+    {
+        zoom = VIEW_MAX_ZOOM;
+    }
+
+    double offsetX = screenY - view.height / 2.0;
+    double offsetY = screenX - view.width / 2.0;
+    view.centerX += offsetX / view.zoom - offsetX / zoom;
+    view.centerY += offsetY / view.zoom - offsetY / zoom;
+    view.zoom = zoom;
+}
+
+inline uint32 mazeView_imagePixel(Maze &maze, uint32 kind, int64 imageX, int64 imageY,
+                                  uint32 gradientLength, RGBcolor *colors, uint32 colorCount)
+{
+    uint32 BLACK = 0x00000000;
+    uint32 WHITE = 0xffffffff;
+
+    if(kind == OUTPUT_SHADED)
+    {
+        if(imageX < 0 || imageY < 0 || imageX >= maze.height || imageY >= maze.width)
+        {
+            return VIEW_BACKGROUND;
+        }
+        return process_cellShade(maze.cells[imageX][imageY].distFromStart, maze.maxDistance,
+                                 gradientLength, colors, colorCount);
+    }
+
+    if(imageX < 0 || imageY < 0 ||
+       imageX > 2*(int64)maze.height || imageY > 2*(int64)maze.width)
+    {
+        return VIEW_BACKGROUND;
+    }
+
+    uint64 X = imageX >> 1;
+    uint64 Y = imageY >> 1;
+    if(X >= maze.height || Y >= maze.width)
+    {
+        return BLACK;
+    }
+
+    Cell &cell = maze.cells[X][Y];
+    uint32 COLOUR = WHITE;
+    if(kind == OUTPUT_WALLS_SHADED)
+    {
+        COLOUR = process_linearInterpolation(cell.distFromStart, maze.maxDistance,
+                                             &colors[0], &colors[1]);
+    }
+
+    switch(((imageX & 1) << 1) | (imageY & 1))
+    {
+    case 0:
+        return BLACK;
+    case 1:
+        return (cell.neighbours[0] != NULL) ? COLOUR : BLACK;
+    case 2:
+        return (cell.neighbours[3] != NULL) ? COLOUR : BLACK;
+    default:
+        return COLOUR;
+    }
+}
+
+// Level L averages 2^L x 2^L image pixels, level 0 is read from the cells
+struct ViewLevel
+{
+    uint32 *texels;
+    uint64 width;
+    uint64 height;
+};
+
+inline uint32 mazeView_texel(ViewLevel &level, int64 X, int64 Y)
+{
+    if(X < 0 || Y < 0 || X >= (int64)level.height || Y >= (int64)level.width)
+    {
+        return VIEW_BACKGROUND;
+    }
+    return level.texels[(uint64)X*level.width + Y];
+}
+
+void mazeView_buildLevels(std::vector<ViewLevel> &levels, WorkerPool &pool, Maze &maze,
+                          uint32 kind, RGBcolor *colors, uint32 colorCount)
+{
+    uint32 gradientLength = process_gradientLength(maze.maxDistance, colorCount);
+
+    ViewLevel image = {};
+    mazeView_imageSize(maze, kind, image.width, image.height);
+    levels.push_back(image);
+
+    while(levels.back().width > 1 || levels.back().height > 1)
+    {
+        ViewLevel below = levels.back();
+        ViewLevel level = {};
+        level.width = (below.width + 1) / 2;
+        level.height = (below.height + 1) / 2;
+        level.texels = (uint32 *)malloc(sizeof(uint32)*level.width*level.height);
+        if(!level.texels)
+        {
+            break;
+        }
+
+        workerPool_forRows(pool, (uint32)level.height, [&](uint32 firstRow, uint32 endRow)
+        {
+            for(uint32 X = firstRow;
+                X < endRow && !isCancelled();
+                ++X)
+            {
+                uint32 *texel = level.texels + (uint64)X*level.width;
+                for(uint64 Y = 0;
+                    Y < level.width;
+                    ++Y)
+                {
+                    uint32 R = 2, G = 2, B = 2;
+                    for(int i = 0; i < 4; ++i)
+                    {
+                        int64 childX = 2*(int64)X + (i >> 1);
+                        int64 childY = 2*(int64)Y + (i & 1);
+                        uint32 colour = below.texels ?
+                            mazeView_texel(below, childX, childY) :
+                            mazeView_imagePixel(maze, kind, childX, childY,
+                                                gradientLength, colors, colorCount);
+                        R += (colour >> 24) & 0xff;
+                        G += (colour >> 16) & 0xff;
+                        B += (colour >> 8) & 0xff;
+                    }
+                    *texel++ = (((R/4) << 24) | ((G/4) << 16) | ((B/4) << 8));
+                }
+            }
+        });
+        levels.push_back(level);
+    }
+}
+
+void mazeView_destroyLevels(std::vector<ViewLevel> &levels)
+{
+    for(uint32 i = 0; i < levels.size(); ++i)
+    {
+        free(levels[i].texels);
+    }
+    levels.clear();
+}
+
+// Zoomed out, the first level at least as coarse as a screen pixel is
+// sampled bilinearly
+void renderMazeView(uint32 *pixels, int pitch, MazeView &view, Maze &maze,
+                    std::vector<ViewLevel> &levels, WorkerPool &pool,
+                    uint32 kind, RGBcolor *colors, uint32 colorCount)
+{
+    double step = 1.0 / view.zoom;
+    double top = view.centerX - view.height*step/2;
+    double left = view.centerY - view.width*step/2;
+
+    uint32 L = 0;
+    while(L + 1 < levels.size() && ldexp(1.0, L) < step)
+    {
+        L++;
+    }
+    ViewLevel &level = levels[L];
+    double scale = ldexp(1.0, -(int)L);
+    double offset = L ? 0.5 : 0.0;
+
+    // Weights are in 1/256th of a texel
+    std::vector<int64> columns(view.width);
+    std::vector<uint32> columnWeights(view.width);
+    for(int32 screenX = 0; screenX < view.width; ++screenX)
+    {
+        double Y = (left + (screenX + 0.5)*step)*scale - offset;
+        columns[screenX] = (int64)floor(Y);
+        columnWeights[screenX] = (uint32)((Y - floor(Y))*256);
+    }
+    uint32 gradientLength = process_gradientLength(maze.maxDistance, colorCount);
+
+    workerPool_forRows(pool, view.height, [&](uint32 firstRow, uint32 endRow)
+    {
+        for(uint32 screenY = firstRow;
+            screenY < endRow;
+            ++screenY)
+        {
+            double X = (top + (screenY + 0.5)*step)*scale - offset;
+            int64 row = (int64)floor(X);
+            uint32 rowWeight = (uint32)((X - floor(X))*256);
+            bool rowsInside = (L && row >= 0 && row + 1 < (int64)level.height);
+            uint32 *upper = rowsInside ? level.texels + (uint64)row*level.width : NULL;
+            uint32 *lower = upper + level.width;
+
+            uint32 *pixel = (uint32 *)((uint8 *)pixels + (int64)pitch*screenY);
+            for(int32 screenX = 0; screenX < view.width; ++screenX)
+            {
+                int64 column = columns[screenX];
+                if(!L)
+                {
+                    *pixel++ = mazeView_imagePixel(maze, kind, row, column,
+                                                   gradientLength, colors, colorCount);
+                    continue;
+                }
+
+                uint32 corners[4];
+                if(rowsInside && column >= 0 && column + 1 < (int64)level.width)
+                {
+                    corners[0] = upper[column];
+                    corners[1] = upper[column + 1];
+                    corners[2] = lower[column];
+                    corners[3] = lower[column + 1];
+                }
+                else
+                {
+                    corners[0] = mazeView_texel(level, row, column);
+                    corners[1] = mazeView_texel(level, row, column + 1);
+                    corners[2] = mazeView_texel(level, row + 1, column);
+                    corners[3] = mazeView_texel(level, row + 1, column + 1);
+                }
+                uint32 columnWeight = columnWeights[screenX];
+                uint32 weights[4] = {
+                    (256 - rowWeight)*(256 - columnWeight),
+                    (256 - rowWeight)*columnWeight,
+                    rowWeight*(256 - columnWeight),
+                    rowWeight*columnWeight,
+                };
+
+                uint32 R = 1 << 15, G = 1 << 15, B = 1 << 15;
+                for(int i = 0; i < 4; ++i)
+                {
+                    R += ((corners[i] >> 24) & 0xff)*weights[i];
+                    G += ((corners[i] >> 16) & 0xff)*weights[i];
+                    B += ((corners[i] >> 8) & 0xff)*weights[i];
+                }
+                *pixel++ = (((R >> 16) << 24) | ((G >> 16) << 16) | ((B >> 16) << 8));
+            }
+        }
+    });
+}
+
+// Returns false when the window was closed, which stops the batch
+bool viewMaze(Maze &maze, uint32 kind, RGBcolor *colors, uint32 colorCount,
+              uint32 scriptedFrames)
+{
+    SDL_Window *window = SDL_CreateWindow("aMAZEd",
+                                          SDL_WINDOWPOS_CENTERED,
+                                          SDL_WINDOWPOS_CENTERED,
+                                          VIEW_WIDTH,
+                                          VIEW_HEIGHT,
+                                          SDL_WINDOW_RESIZABLE);
+    if(!window)
+    {
+        printf("Couldn't open the viewer : \n%s\n", SDL_GetError());
+        return true;
+    }
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
+    if(!renderer)
+    {
+        printf("Couldn't open the viewer : \n%s\n", SDL_GetError());
+        SDL_DestroyWindow(window);
+        return true;
+    }
+    SDL_Texture *texture = NULL;
+
+    MazeView view = {};
+    view.width = VIEW_WIDTH;
+    view.height = VIEW_HEIGHT;
+    mazeView_fit(view, maze, kind);
+
+    WorkerPool pool;
+    workerPool_start(pool, workerCount);
+    std::vector<ViewLevel> levels;
+    mazeView_buildLevels(levels, pool, maze, kind, colors, colorCount);
+
+    double scriptedZoom = 1.0;
+    if(scriptedFrames)
+    {
+        scriptedZoom = pow(VIEW_MAX_ZOOM / view.zoom, 1.0 / scriptedFrames);
+    }
+
+    bool nextMaze = true;
+    bool running = true;
+    bool dirty = true;
+    uint32 frameCount = 0;
+    double totalFrameTime = 0.0;
+    double worstFrameTime = 0.0;
+    while(running && !isCancelled())
+    {
+        SDL_Event event;
+        while(SDL_PollEvent(&event))
+        {
+            switch(event.type)
+            {
+            case SDL_QUIT:
+            {
+                running = false;
+                nextMaze = false;
+            } break;
+            case SDL_WINDOWEVENT:
+            {
+                if(event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                {
+                    view.width = event.window.data1;
+                    view.height = event.window.data2;
+                    if(texture)
+                    {
+                        SDL_DestroyTexture(texture);
+                        texture = NULL;
+                    }
+                    dirty = true;
+                }
+            } break;
+            case SDL_KEYDOWN:
+            {
+                switch(event.key.keysym.sym)
+                {
+                case SDLK_ESCAPE:
+                case SDLK_q:
+                    running = false;
+                    break;
+                case SDLK_UP:
+                    view.centerX -= VIEW_PAN_STEP / view.zoom;
+                    break;
+                case SDLK_DOWN:
+                    view.centerX += VIEW_PAN_STEP / view.zoom;
+                    break;
+                case SDLK_LEFT:
+                    view.centerY -= VIEW_PAN_STEP / view.zoom;
+                    break;
+                case SDLK_RIGHT:
+                    view.centerY += VIEW_PAN_STEP / view.zoom;
+                    break;
+                case SDLK_PLUS:
+                case SDLK_EQUALS:
+                    mazeView_zoom(view, VIEW_ZOOM_STEP, view.width / 2, view.height / 2);
+                    break;
+                case SDLK_MINUS:
+                    mazeView_zoom(view, 1.0 / VIEW_ZOOM_STEP, view.width / 2, view.height / 2);
+                    break;
+                case SDLK_0:
+                    mazeView_fit(view, maze, kind);
+                    break;
+                }
+                dirty = true;
+            } break;
+            case SDL_MOUSEWHEEL:
+            {
+                int mouseX, mouseY;
+                SDL_GetMouseState(&mouseX, &mouseY);
+                double factor = (event.wheel.y > 0) ? VIEW_ZOOM_STEP : 1.0 / VIEW_ZOOM_STEP;
+                mazeView_zoom(view, factor, mouseX, mouseY);
+                dirty = true;
+            } break;
+            case SDL_MOUSEMOTION:
+            {
+                if(event.motion.state & SDL_BUTTON_LMASK)
+                {
+                    view.centerX -= event.motion.yrel / view.zoom;
+                    view.centerY -= event.motion.xrel / view.zoom;
+                    dirty = true;
+                }
+            } break;
+            }
+        }
+
+        if(scriptedFrames)
+        {
+            if(frameCount == scriptedFrames)
+            {
+                break;
+            }
+            mazeView_zoom(view, scriptedZoom, view.width / 3, view.height / 3);
+            dirty = true;
+        }
+
+        if(!dirty || !running)
+        {
+            SDL_Delay(VIEW_IDLE_DELAY_MS);
+            continue;
+        }
+
+        if(!texture)
+        {
+            texture = SDL_CreateTexture(renderer,
+                                        SDL_PIXELFORMAT_RGBA8888,
+                                        SDL_TEXTUREACCESS_STREAMING,
+                                        view.width,
+                                        view.height);
+            SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+        }
+
+        void *pixels;
+        int pitch;
+        if(SDL_LockTexture(texture, NULL, &pixels, &pitch) == 0)
+        {
+            uint64 frameStart = SDL_GetPerformanceCounter();
+            renderMazeView((uint32 *)pixels, pitch, view, maze, levels, pool,
+                           kind, colors, colorCount);
+            double frameTime = (double)(SDL_GetPerformanceCounter() - frameStart) /
+                               SDL_GetPerformanceFrequency();
+            SDL_UnlockTexture(texture);
+
+            totalFrameTime += frameTime;
+            if(frameTime > worstFrameTime)
+            {
+                worstFrameTime = frameTime;
+            }
+            frameCount++;
+        }
+
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+        dirty = false;
+    }
+
+    if(frameCount)
+    {
+        printf("%u frames, %.2fms per frame on average, %.2fms at worst\n",
+               frameCount, 1000.0*totalFrameTime / frameCount, 1000.0*worstFrameTime);
+    }
+
+    mazeView_destroyLevels(levels);
+    workerPool_stop(pool);
+    if(texture)
+    {
+        SDL_DestroyTexture(texture);
+    }
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+
+    return nextMaze;
+}
+
+void renderGradiant(SDL_Surface *buffer)
+{
+    uint8 *row = (uint8 *)buffer->pixels;
+    for(int Y = 0;
+        Y < buffer->h;
+        ++Y)
+    {
+        uint32 *pixel = (uint32 *)row;
+        for(int X = 0;
+            X < buffer->w;
+            ++X)
+        {
+            uint8 red = X;
+            uint8 green = Y;
+            uint8 blue = 0;
+            uint8 alpha = 0;
+
+            *pixel++ = ((red << 24) | (green << 16) | (blue << 8) | alpha);
+        }
+        row += buffer->pitch;
+    }
+}
+
+inline void writeLittleEndian(uint8 *destination, uint32 value, int byteCount)
+{
+    for(int i = 0; i < byteCount; ++i)
+    {
+        destination[i] = (uint8)(value >> (8*i));
+    }
+}
+
+// A negative height stores the rows top to bottom
+void writeBMPHeader(uint8 *header, uint32 width, int32 height)
+{
+    const uint32 FILE_HEADER_SIZE = 14;
+    const uint32 INFO_HEADER_SIZE = 40;
+    uint64 rowSize = (uint64)width*4;
+    uint64 pixelsSize = rowSize*(height < 0 ? -(int64)height : height);
+    uint64 fileSize = BMP_HEADER_SIZE + pixelsSize;
+
+    memset(header, 0, BMP_HEADER_SIZE);
+    header[0] = 'B';
+    header[1] = 'M';
+    writeLittleEndian(header + 2, (uint32)fileSize, 4);
+    writeLittleEndian(header + 10, BMP_HEADER_SIZE, 4);
+
+    uint8 *info = header + FILE_HEADER_SIZE;
+    writeLittleEndian(info + 0, INFO_HEADER_SIZE, 4);
+    writeLittleEndian(info + 4, width, 4);
+    writeLittleEndian(info + 8, (uint32)height, 4);
+    writeLittleEndian(info + 12, 1, 2);
+    writeLittleEndian(info + 14, 32, 2);
+    writeLittleEndian(info + 16, 3, 4); // BI_BITFIELDS
+    writeLittleEndian(info + 20, (uint32)pixelsSize, 4);
+    writeLittleEndian(info + 24, 2835, 4);
+    writeLittleEndian(info + 28, 2835, 4);
+
+    uint8 *masks = info + INFO_HEADER_SIZE;
+    writeLittleEndian(masks + 0, 0xff000000, 4);
+    writeLittleEndian(masks + 4, 0x00ff0000, 4);
+    writeLittleEndian(masks + 8, 0x0000ff00, 4);
+}
+
+bool openMappedBMP(MappedImage &image, const char *filename, uint32 width, uint32 height)
+{
+#ifdef _WIN32
+    (void)image; (void)filename; (void)width; (void)height;
+    return false;
+#else
+    uint64 rowSize = (uint64)width*4;
+    uint64 pixelsSize = rowSize*height;
+    uint64 fileSize = BMP_HEADER_SIZE + pixelsSize;
+    if(fileSize > BMP_MAX_FILE_SIZE)
+    {
+        printf("Image too large for a BMP file\n");
+        return false;
+    }
+
+    image.file = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(image.file < 0)
+    {
+        return false;
+    }
+    // A full disk fails here rather than with a SIGBUS while rendering
+    int reserveError = posix_fallocate(image.file, 0, fileSize);
+    if(reserveError != 0)
+    {
+        printf("Couldn't reserve %llu bytes for %s : %s\n",
+               (unsigned long long)fileSize, filename, strerror(reserveError));
+        close(image.file);
+        unlink(filename);
+        return false;
+    }
+
+    image.mappingSize = fileSize;
+    image.mapping = (uint8 *)mmap(NULL, fileSize, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED, image.file, 0);
+    if(image.mapping == MAP_FAILED)
+    {
+        close(image.file);
+        return false;
+    }
+    madvise(image.mapping, fileSize, MADV_SEQUENTIAL);
+
+    writeBMPHeader(image.mapping, width, -(int32)height);
+
+    SDL_Surface view = {};
+    view.w = width;
+    view.h = height;
+    view.pitch = (int)rowSize;
+    view.pixels = image.mapping + BMP_HEADER_SIZE;
+    assert(((uintptr_t)view.pixels % sizeof(uint32)) == 0);
+    image.surface = view;
+
+    return true;
+#endif
+}
+
+bool closeMappedBMP(MappedImage &image)
+{
+#ifdef _WIN32
+    (void)image;
+    return false;
+#else
+    bool closed = (msync(image.mapping, image.mappingSize, MS_SYNC) == 0);
+    closed = (munmap(image.mapping, image.mappingSize) == 0) && closed;
+    closed = (close(image.file) == 0) && closed;
+    return closed;
+#endif
+}
+
+void discardMappedBMP(MappedImage &image, const char *filename)
+{
+#ifndef _WIN32
+    munmap(image.mapping, image.mappingSize);
+    close(image.file);
+    unlink(filename);
+#endif
+}
+
+// Images past the size of a BMP file are split in "<name>_<k>.bmp" tiles
+struct StreamedBMP
+{
+    FILE *file;
+    char filename[512];
+    uint32 width;
+    uint64 height;
+    uint64 rowsPerTile;
+    uint64 rowsWritten;
+    uint32 tileCount;
+};
+
+void streamedBMP_tileName(StreamedBMP &image, uint32 tile, char *tileName)
+{
+    if(image.tileCount == 1)
     {
-        maze.cells[X] = (Cell *)malloc(sizeof(Cell)*maze.width);
-        for(uint32 Y = 0;
-            Y < maze.width;
-            ++Y)
+        strcpy(tileName, image.filename);
+        return;
+    }
+
+    strcpy(tileName, image.filename);
+    char *lastDot = strrchr(tileName, '.');
+    if(lastDot)
+    {
+        *lastDot = '\0';
+    }
+    sprintf(tileName + strlen(tileName), "_%u.bmp", tile);
+}
+
+bool streamedBMP_open(StreamedBMP &image, const char *filename, uint32 width, uint64 height)
+{
+    uint64 rowSize = (uint64)width*4;
+
+    image.file = NULL;
+    strcpy(image.filename, filename);
+    image.width = width;
+    image.height = height;
+    image.rowsWritten = 0;
+    image.rowsPerTile = (BMP_MAX_FILE_SIZE - BMP_HEADER_SIZE) / rowSize;
+    if(image.rowsPerTile > 0x7fffffff)
+    {
+        image.rowsPerTile = 0x7fffffff;
+    }
+    if(image.rowsPerTile == 0)
+    {
+        return false;
+    }
+    image.tileCount = (uint32)((height + image.rowsPerTile - 1) / image.rowsPerTile);
+
+    return true;
+}
+
+bool streamedBMP_writeRows(StreamedBMP &image, const uint8 *rows, int64 pitch, uint64 rowCount)
+{
+    uint64 rowSize = (uint64)image.width*4;
+    for(uint64 R = 0; R < rowCount; ++R)
+    {
+        if(image.rowsWritten % image.rowsPerTile == 0)
         {
-            Cell dummy = {};
-            dummy.distFromStart = 0;
-            dummy.visited = 0;
-            dummy.position.X = X;
-            dummy.position.Y = Y;
-            for(int N = 0; N < 4; ++N)
+            if(image.file && fclose(image.file) != 0)
             {
-                dummy.neighbours[N] = NULL;
+                image.file = NULL;
+                return false;
             }
 
-            maze.cells[X][Y] = dummy;
+            uint32 tile = (uint32)(image.rowsWritten / image.rowsPerTile);
+            uint64 tileRows = image.height - image.rowsWritten;
+            if(tileRows > image.rowsPerTile)
+            {
+                tileRows = image.rowsPerTile;
+            }
+
+            char tileName[600];
+            streamedBMP_tileName(image, tile, tileName);
+            image.file = fopen(tileName, "wb");
+            if(!image.file)
+            {
+                return false;
+            }
+
+            uint8 header[BMP_HEADER_SIZE];
+            writeBMPHeader(header, image.width, -(int32)tileRows);
+            if(fwrite(header, 1, BMP_HEADER_SIZE, image.file) != BMP_HEADER_SIZE)
+            {
+                return false;
+            }
+        }
+
+        if(fwrite(rows + pitch*(int64)R, 1, rowSize, image.file) != rowSize)
+        {
+            return false;
         }
+        image.rowsWritten++;
     }
 
-    // Generate the maze
-    generate_recursiveBacktrack(maze, randomDir);
+    return true;
+}
 
-    process_distanceFromStart(maze);
+bool streamedBMP_close(StreamedBMP &image)
+{
+    bool closed = (image.rowsWritten == image.height);
+    if(image.file && fclose(image.file) != 0)
+    {
+        closed = false;
+    }
+    image.file = NULL;
+
+    return closed;
 }
 
-void destroyMaze(Maze &maze)
+void streamedBMP_discard(StreamedBMP &image)
 {
-    for(uint32 i = 0; i < maze.height; i++)
+    if(image.file)
     {
-        free(maze.cells[i]);
+        fclose(image.file);
+        image.file = NULL;
+    }
+
+    uint32 tilesStarted = (uint32)((image.rowsWritten + image.rowsPerTile - 1) / image.rowsPerTile);
+    for(uint32 tile = 0; tile < tilesStarted; ++tile)
+    {
+        char tileName[600];
+        streamedBMP_tileName(image, tile, tileName);
+        remove(tileName);
     }
-    free(maze.cells);
 }
 
-void SDL_DrawCircle(SDL_Surface *surface, Coordinates &center, int R, uint32 colour)
+// Generated, rendered and written one band of bandRows cell rows at a time
+bool streamWallBitsMaze(const char *filename, uint32 width, uint32 height,
+                        uint32 algorithm, uint64 seed, uint32 bandRows)
 {
-    int X = 0;
-    int Y = R;
-    int d = R-1;
-    uint32 *buffer = (uint32 *)surface->pixels;
+    uint32 imageWidth = 2*width + 1;
+    uint64 imageHeight = 2*(uint64)height + 1;
+
+    StreamedBMP image = {};
+    if(!streamedBMP_open(image, filename, imageWidth, imageHeight))
+    {
+        printf("Image rows too large for a BMP file\n");
+        return false;
+    }
+    if(image.tileCount > 1)
+    {
+        printf("Writing the image as %u tiles of %llu rows\n",
+               image.tileCount, (unsigned long long)image.rowsPerTile);
+    }
 
-    while(Y >= X)
+    WallBits bits = {};
+    buildWallBits(bits, width, bandRows);
+    SDL_Surface *band = SDL_CreateRGBSurface(0,
+                                             imageWidth,
+                                             2*bandRows,
+                                             32,
+                                             0xff000000,
+                                             0x00ff0000,
+                                             0x0000ff00,
+                                             0x000000ff);
+
+    bool written = (band != NULL);
+    for(uint32 firstRow = 0; written && firstRow < height; firstRow += bandRows)
     {
-        *(buffer+ (center.X + X)*surface->w + (center.Y + Y)) = colour;
-        *(buffer+ (center.X + Y)*surface->w + (center.Y + X)) = colour;
-        *(buffer+ (center.X - X)*surface->w + (center.Y + Y)) = colour;
-        *(buffer+ (center.X - Y)*surface->w + (center.Y + X)) = colour;
-        *(buffer+ (center.X + X)*surface->w + (center.Y - Y)) = colour;
-        *(buffer+ (center.X + Y)*surface->w + (center.Y - X)) = colour;
-        *(buffer+ (center.X - X)*surface->w + (center.Y - Y)) = colour;
-        *(buffer+ (center.X - Y)*surface->w + (center.Y - X)) = colour;
+        bits.firstRow = firstRow;
+        bits.height = (height - firstRow < bandRows) ? height - firstRow : bandRows;
 
-        if(d >= 2*X)
+        if(algorithm == ALGORITHM_BINARY_TREE)
+            generate_binaryTree(bits, seed);
+        else
+            generate_sidewinder(bits, seed);
+        renderWallBits_Walls(band, bits);
+
+        if(isCancelled())
         {
-            d = d-2*X-1;
-            X++;
+            written = false;
+            break;
         }
-        else if(d < 2*(R-Y))
+        written = streamedBMP_writeRows(image, (uint8 *)band->pixels, band->pitch, 2*(uint64)bits.height);
+        if(written)
         {
-            d = d+2*Y-1;
-            Y--;
+            progress.bytesWritten.fetch_add(2*(uint64)bits.height*imageWidth*4);
         }
-        else
+    }
+
+    if(written)
+    {
+        // The bottom border row
+        memset(band->pixels, 0, (uint64)imageWidth*4);
+        written = streamedBMP_writeRows(image, (uint8 *)band->pixels, band->pitch, 1);
+        if(written)
         {
-            d = d+2*(Y-X-1);
-            Y--;
-            X++;
+            progress.bytesWritten.fetch_add((uint64)imageWidth*4);
         }
     }
+    if(written)
+    {
+        written = streamedBMP_close(image);
+    }
+    if(!written)
+    {
+        streamedBMP_discard(image);
+    }
+
+    SDL_FreeSurface(band);
+    destroyWallBits(bits);
+
+    return written;
 }
 
-void SDL_DrawLine(SDL_Surface *surface, Coordinates A, Coordinates B, uint32 colour)
+// "AMZB", width, height and maze count, then the north and west rows of
+// every maze on (width+7)/8 bytes each, all little endian
+struct SmallMazeBlobWriter
 {
-    uint32 *buffer = (uint32 *)surface->pixels;
-    int X = A.X;
-    int Y = A.X;
-    int W = B.X - A.X;
-    int H = B.Y - A.Y;
-    int dX1 = 0-(W<0)+(W>0);
-    int dX2 = dX1;
-    int dY1 = 0-(H<0)+(H>0);
-    int dY2 = 0;
+    FILE *file;
+    uint64 seed;
+    uint32 mazeCount;
+    bool written;
 
-    int longest = abs(W);
-    int shortest = abs(H);
-    if(longest < shortest)
+    template<uint32 Width, uint32 Height>
+    void run()
     {
-        longest = abs(H);
-        shortest = abs(W);
-        dY2 = 0-(H<0)+(H>0);
-        dX2 = 0;
+        const uint32 rowBytes = (Width + 7) / 8;
+        const uint32 mazeBytes = 2*Height*rowBytes;
+
+        uint8 header[16] = { 'A', 'M', 'Z', 'B' };
+        writeLittleEndian(header + 4, Width, 4);
+        writeLittleEndian(header + 8, Height, 4);
+        writeLittleEndian(header + 12, mazeCount, 4);
+        written = (fwrite(header, 1, sizeof(header), file) == sizeof(header));
+
+        uint8 *chunk = (uint8 *)malloc((uint64)mazeBytes*SMALL_MAZE_CHUNK);
+        if(!chunk)
+        {
+            written = false;
+        }
+        for(uint32 first = 0; written && first < mazeCount && !isCancelled(); first += SMALL_MAZE_CHUNK)
+        {
+            uint32 chunkCount = mazeCount - first;
+            if(chunkCount > SMALL_MAZE_CHUNK)
+            {
+                chunkCount = SMALL_MAZE_CHUNK;
+            }
+
+            parallel_forRows(chunkCount, [&](uint32 firstMaze, uint32 endMaze)
+            {
+                SmallMaze<Width, Height> maze;
+                for(uint32 i = firstMaze; i < endMaze; ++i)
+                {
+                    generate_smallMaze(maze, random_counter64(seed, first + i));
+
+                    uint8 *destination = chunk + (uint64)i*mazeBytes;
+                    for(uint32 X = 0; X < Height; ++X)
+                    {
+                        for(uint32 B = 0; B < rowBytes; ++B)
+                        {
+                            destination[X*rowBytes + B] = (uint8)(maze.north[X] >> (8*B));
+                            destination[(Height + X)*rowBytes + B] = (uint8)(maze.west[X] >> (8*B));
+                        }
+                    }
+                }
+            });
+
+            written = (fwrite(chunk, mazeBytes, chunkCount, file) == chunkCount);
+            progress.mazeIndex.store(first + chunkCount);
+        }
+        free(chunk);
     }
+};
 
-    int numerator = longest/2;
-    for(int i = 0; i <= longest; i++)
+struct SmallMazeBenchmark
+{
+    uint64 seed;
+    double seconds;
+
+    template<uint32 Width, uint32 Height>
+    void run()
     {
-        *(buffer+ (X)*surface->w + (Y)) = colour;
-        numerator += shortest;
-        if(numerator>longest)
+        std::atomic<uint64> generated(0);
+        std::atomic<uint64> sink(0);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> budget(seconds);
+
+        std::vector<std::thread> workers;
+        for(uint32 T = 0; T < workerCount; ++T)
         {
-            numerator -= longest;
-            X += dX1;
-            Y += dY1;
+            workers.push_back(std::thread([&, T]()
+            {
+                SmallMaze<Width, Height> maze;
+                uint64 counter = (uint64)T << 40;
+                uint64 check = 0;
+                while(std::chrono::steady_clock::now() - start < budget && !isCancelled())
+                {
+                    for(uint32 i = 0; i < SMALL_MAZE_BENCH_BATCH; ++i)
+                    {
+                        generate_smallMaze(maze, random_counter64(seed, counter++));
+                        check ^= maze.north[Height / 2] ^ maze.west[Height / 2];
+                    }
+                    generated.fetch_add(SMALL_MAZE_BENCH_BATCH);
+                }
+                sink.fetch_xor(check);
+            }));
         }
-        else
+        for(uint32 T = 0; T < workers.size(); ++T)
         {
-            X += dX2;
-            Y += dY2;
+            workers[T].join();
         }
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double rate = generated.load() / elapsed;
+        printf("%ux%u : %llu mazes in %.2fs, %.0f mazes/s, %.0f mazes/s/core (%u workers, check %llx)\n",
+               Width, Height, (unsigned long long)generated.load(), elapsed,
+               rate, rate / workerCount, workerCount, (unsigned long long)(sink.load() & 0xffff));
     }
-}
+};
 
-void SDL_DrawOrientedLine(SDL_Surface *surface,
-                          Coordinates O,
-                          double angle,
-                          int start,
-                          int length,
-                          uint32 colour)
+// Entries are "<key>.bmp" and "<key>.json", their mtime is the last use
+inline uint64 hash_fnv1a(uint64 hash, const void *data, uint64 size)
 {
-    Coordinates A = {}, B = {};
-    double sine = sin(angle);
-    double cosine = cos(angle);
+    const uint8 *bytes = (const uint8 *)data;
+    for(uint64 i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
 
-    A.X = O.X + round(sine*start);
-    A.Y = O.Y + round(cosine*start);
-    B.X = O.X + round(sine*(start+length));
-    B.Y = O.Y + round(cosine*(start+length));
+    return hash;
+}
 
-    SDL_DrawLine(surface, A, B, colour);
+void cache_entryPath(char *path, const char *directory, uint64 key, const char *extension)
+{
+    sprintf(path, "%s/%016llx%s", directory, (unsigned long long)key, extension);
 }
 
-void renderMaze_Walls(SDL_Surface *buffer, Maze &maze)
-{ 
-    uint32 BLACK = 0x00000000;
-    uint32 WHITE = 0xffffffff;
+bool cache_copyFile(const char *from, const char *to)
+{
+    FILE *source = fopen(from, "rb");
+    if(!source)
+    {
+        return false;
+    }
+    FILE *destination = fopen(to, "wb");
+    if(!destination)
+    {
+        fclose(source);
+        return false;
+    }
 
-    uint8 *row = (uint8 *)buffer->pixels;
-    uint8 *nextRow = row + buffer->pitch;
-    for(uint32 X = 0;
-        X < maze.height;
-        ++X)
+    bool copied = true;
+    static uint8 buffer[1 << 16];
+    size_t readSize;
+    while((readSize = fread(buffer, 1, sizeof(buffer), source)) > 0)
     {
-        uint32 *pixel = (uint32 *)row;
-        uint32 *nextPixel = (uint32 *)nextRow;
-        for(uint32 Y = 0;
-            Y < maze.width;
-            ++Y)
+        if(fwrite(buffer, 1, readSize, destination) != readSize)
         {
-            *pixel++ = BLACK;
-            *pixel++ = (maze.cells[X][Y].neighbours[0] == NULL) ? BLACK : WHITE;
-            *nextPixel++ = (maze.cells[X][Y].neighbours[3] == NULL) ? BLACK : WHITE;
-            *nextPixel++ = WHITE;
+            copied = false;
+            break;
         }
-        *pixel++ = BLACK;
-        *nextPixel++ = (maze.cells[X][maze.width-1].neighbours[1] == NULL) ? BLACK : WHITE;
+    }
+    if(ferror(source))
+    {
+        copied = false;
+    }
 
-        row += buffer->pitch*2;
-        nextRow += buffer->pitch*2;
+    fclose(source);
+    if(fclose(destination) != 0)
+    {
+        copied = false;
+    }
+    if(!copied)
+    {
+        remove(to);
     }
+
+    return copied;
 }
 
-uint32 process_linearInterpolation(uint32 value, uint32 maxValue,
-                                  RGBcolor* startColor, RGBcolor* maxColor)
-{ 
-        double coeff = (double)value/ (double)maxValue;
-        uint8 R = (startColor->red + 
-                  (uint8)(coeff * (maxColor->red - startColor->red)))%256;
-        uint8 G = (startColor->green + 
-                  (uint8)(coeff * (maxColor->green - startColor->green)))%256;
-        uint8 B = (startColor->blue + 
-                  (uint8)(coeff * (maxColor->blue - startColor->blue)))%256;
+// Never a hard link, a later write of the output would rewrite the entry
+bool cache_placeFile(const char *from, const char *to)
+{
+#ifdef _WIN32
+    (void)from; (void)to;
+    return false;
+#else
+    static uint32 placeCounter = 0;
+    char temporary[600];
+    sprintf(temporary, "%s.tmp.%d.%u", to, (int)getpid(), placeCounter++);
 
-        uint32 COLOUR = ((R << 24) | (G << 16) | (B << 8));
-        return COLOUR;
+    if(!cache_copyFile(from, temporary))
+    {
+        return false;
+    }
+    if(rename(temporary, to) != 0)
+    {
+        unlink(temporary);
+        return false;
+    }
+
+    return true;
+#endif
 }
 
-void renderMaze_WallsShaded(SDL_Surface *buffer, Maze &maze, 
-                            RGBcolor startColor, RGBcolor maxColor)
-{    
-    uint32 BLACK = 0x00000000;
-    uint32 COLOUR = 0xffffffff;
+bool cache_fetch(const char *directory, uint64 key, const char *extension, const char *destination)
+{
+#ifdef _WIN32
+    (void)directory; (void)key; (void)extension; (void)destination;
+    return false;
+#else
+    char path[600];
+    cache_entryPath(path, directory, key, extension);
+    if(access(path, R_OK) != 0 || !cache_placeFile(path, destination))
+    {
+        return false;
+    }
+    utime(path, NULL);
 
-    uint32 maxDistance = maze.maxDistance;
+    return true;
+#endif
+}
 
-    uint8 *row = (uint8 *)buffer->pixels;
-    uint8 *nextRow = row + buffer->pitch;
-    for(uint32 X = 0;
-        X < maze.height;
-        ++X)
+void cache_store(const char *directory, uint64 key, const char *extension, const char *source)
+{
+    char path[600];
+    cache_entryPath(path, directory, key, extension);
+    if(!cache_placeFile(source, path))
     {
-        uint32 *pixel = (uint32 *)row;
-        uint32 *nextPixel = (uint32 *)nextRow;
-        for(uint32 Y = 0;
-            Y < maze.width;
-            ++Y)
+        printf("Couldn't add %s to the cache\n", source);
+    }
+}
+
+struct CacheEntry
+{
+    time_t lastUse;
+    uint64 size;
+    char name[256];
+};
+
+void cache_evict(const char *directory, uint64 sizeLimit)
+{
+#ifndef _WIN32
+    DIR *cacheDirectory = opendir(directory);
+    if(!cacheDirectory)
+    {
+        return;
+    }
+
+    std::vector<CacheEntry> entries;
+    uint64 totalSize = 0;
+    time_t now = time(NULL);
+    char path[600];
+    struct dirent *directoryEntry;
+    while((directoryEntry = readdir(cacheDirectory)) != NULL)
+    {
+        if(directoryEntry->d_name[0] == '.' ||
+           strlen(directoryEntry->d_name) >= sizeof(CacheEntry::name))
         {
-            COLOUR = process_linearInterpolation(maze.cells[X][Y].distFromStart,
-                                                 maxDistance,
-                                                 &startColor,
-                                                 &maxColor);
+            continue;
+        }
 
-            *pixel++ = BLACK;
-            *pixel++ = (maze.cells[X][Y].neighbours[0] == NULL) ? BLACK : COLOUR;
-            *nextPixel++ = (maze.cells[X][Y].neighbours[3] == NULL) ? BLACK : COLOUR;
-            *nextPixel++ = COLOUR;
+        sprintf(path, "%s/%s", directory, directoryEntry->d_name);
+        struct stat status;
+        if(stat(path, &status) != 0 || !S_ISREG(status.st_mode))
+        {
+            continue;
         }
-        *pixel++ = BLACK;
-        *nextPixel++ = (maze.cells[X][maze.width-1].neighbours[1] == NULL) ? BLACK : COLOUR;
 
-        row += buffer->pitch*2;
-        nextRow += buffer->pitch*2;
+        if(strstr(directoryEntry->d_name, ".tmp."))
+        {
+            if(now - status.st_mtime > CACHE_STALE_TEMPORARY)
+            {
+                unlink(path);
+            }
+            continue;
+        }
+
+        CacheEntry entry = {};
+        entry.lastUse = status.st_mtime;
+        entry.size = (uint64)status.st_size;
+        strcpy(entry.name, directoryEntry->d_name);
+        entries.push_back(entry);
+        totalSize += entry.size;
+    }
+    closedir(cacheDirectory);
+
+    std::sort(entries.begin(), entries.end(),
+              [](const CacheEntry &a, const CacheEntry &b) { return a.lastUse < b.lastUse; });
+
+    for(size_t i = 0; i < entries.size() && totalSize > sizeLimit; ++i)
+    {
+        sprintf(path, "%s/%s", directory, entries[i].name);
+        if(unlink(path) == 0)
+        {
+            totalSize -= entries[i].size;
+        }
+    }
+#else
+    (void)directory; (void)sizeLimit;
+#endif
+}
+
+// Everything that changes the bytes of the outputs goes in the key
+uint64 cacheKey_forMaze(Maze &maze, uint32 algorithm, uint32 directionPolicy,
+                        uint32 topology, bool polar, uint8 renderType,
+                        RGBcolor *colors, uint32 colorCount, bool mappedOutput)
+{
+    uint64 parameters[] =
+    {
+        CACHE_FORMAT_VERSION,
+        maze.width, maze.height, maze.depth, maze.seed,
+        algorithm, directionPolicy, topology, polar ? 1u : 0u,
+        renderType, colorCount, mappedOutput ? 1u : 0u,
+        (algorithm == ALGORITHM_PARALLEL_BACKTRACK) ? workerCount : 0u,
+    };
+
+    uint64 key = hash_fnv1a(0xcbf29ce484222325ULL, parameters, sizeof(parameters));
+    for(uint32 i = 0; i < colorCount; ++i)
+    {
+        uint8 colour[3] = { colors[i].red, colors[i].green, colors[i].blue };
+        key = hash_fnv1a(key, colour, sizeof(colour));
+    }
+
+    return key;
+}
+
+struct MemoryRequest
+{
+    uint64 width;
+    uint64 height;
+    uint32 algorithm;
+    uint32 topology;
+    bool polar;
+    uint8 renderType;
+    uint32 *extraOutputKinds;
+    uint32 extraOutputCount;
+    bool writeStats;
+    bool mappedOutput;
+    bool view;
+};
+
+// Peak memory of one maze for every strategy, 0 when it can't do the request
+struct MemoryPlan
+{
+    uint32 strategy;
+    uint64 peakBytes[STRATEGY_COUNT];
+    const char *reasons[STRATEGY_COUNT];
+    uint32 bandRows;
+};
+
+inline const char *strategy_name(uint32 strategy)
+{
+    static const char *strategyNames[] = { "in-memory", "compact", "streaming" };
+    return strategyNames[strategy];
+}
+
+inline uint64 plan_imageBytes(uint64 width, uint64 height)
+{
+    return width*height*4;
+}
+
+inline bool plan_imageFits(uint64 width, uint64 height)
+{
+    return (width*4 <= 0x7fffffff && height <= 0x7fffffff &&
+            BMP_HEADER_SIZE + plan_imageBytes(width, height) <= BMP_MAX_FILE_SIZE);
+}
+
+bool plan_mainImage(MemoryRequest &request, uint64 &imageWidth, uint64 &imageHeight)
+{
+    imageWidth = request.width;
+    imageHeight = request.height;
+    if(request.polar)
+    {
+        imageWidth = 2*request.height*POLAR_RING_HEIGHT + 3;
+        imageHeight = imageWidth;
+    }
+    else if(request.renderType & RENDER_WALLS)
+    {
+        imageWidth = 2*request.width + 1;
+        imageHeight = 2*request.height + 1;
     }
+
+    return plan_imageFits(imageWidth, imageHeight);
 }
 
-void renderMaze_Shaded(SDL_Surface *buffer, 
-                       Maze &maze, RGBcolor startColor, RGBcolor maxColor)
+template<typename Topology>
+uint64 plan_cellGraphBytes(uint64 cellCount, uint64 rowCount)
 {
-    uint32 maxDistance = maze.maxDistance;
+    uint64 stackEntry = sizeof(Coordinates);
+    if(sizeof(DistanceTask<Topology>) > stackEntry)
+    {
+        stackEntry = sizeof(DistanceTask<Topology>);
+    }
 
-    uint8 *row = (uint8 *)buffer->pixels;
-    for(uint32 X = 0;
-        X < maze.height;
-        ++X)
+    return rowCount*sizeof(CellT<Topology> *) + cellCount*(sizeof(CellT<Topology>) + stackEntry);
+}
+
+void plan_memory(MemoryPlan &plan, MemoryRequest &request, uint64 memoryLimit)
+{
+    for(uint32 i = 0; i < STRATEGY_COUNT; ++i)
     {
-        uint32 *pixel = (uint32 *)row;
-        for(uint32 Y = 0;
-            Y < maze.width;
-            ++Y)
+        plan.peakBytes[i] = 0;
+        plan.reasons[i] = NULL;
+    }
+    plan.strategy = STRATEGY_NONE;
+    plan.bandRows = 0;
+
+    uint64 cellCount = request.width*request.height;
+    uint64 wordsPerRow = (request.width + 63) / 64;
+    uint64 wallBitsBytes = 2*wordsPerRow*request.height*sizeof(uint64);
+    bool rowAlgorithm = (request.algorithm == ALGORITHM_BINARY_TREE ||
+                         request.algorithm == ALGORITHM_SIDEWINDER);
+    bool square = (!request.polar && request.topology == TOPOLOGY_SQUARE);
+    bool wallBitsOnly = (square && rowAlgorithm && request.renderType == RENDER_WALLS &&
+                         !request.writeStats && !request.extraOutputCount && !request.view);
+
+    // The maze itself
+    uint64 mazeBytes = 0;
+    const char *mazeReason = NULL;
+    if(request.polar)
+    {
+        uint64 polarCells = (uint64)ceil(PI*request.height*request.height) + request.height;
+        mazeBytes = polarCells*(sizeof(PolarCell) + sizeof(uint32) + 2*sizeof(float)) +
+                    request.height*2*sizeof(uint32);
+        if(polarCells > 0xffffffffULL)
+            mazeReason = "more than 2^32 cells";
+    }
+    else if(wallBitsOnly)
+    {
+        mazeBytes = wallBitsBytes;
+    }
+    else
+    {
+        switch(request.topology)
         {
-            *pixel++ = process_linearInterpolation(maze.cells[X][Y].distFromStart,
-                                                   maxDistance,
-                                                   &startColor,
-                                                   &maxColor);
+        case TOPOLOGY_HEX:
+            mazeBytes = plan_cellGraphBytes<HexTopology>(cellCount, request.height);
+            break;
+        case TOPOLOGY_TRIANGLE:
+            mazeBytes = plan_cellGraphBytes<TriangleTopology>(cellCount, request.height);
+            break;
+        case TOPOLOGY_CUBE:
+            mazeBytes = plan_cellGraphBytes<CubeTopology>(cellCount, request.height);
+            break;
+        default:
+            mazeBytes = plan_cellGraphBytes<SquareTopology>(cellCount, request.height);
+            break;
         }
-        row += buffer->pitch;
+        if(square && rowAlgorithm)
+            mazeBytes += wallBitsBytes;
+        if(request.writeStats)
+            mazeBytes += cellCount*(sizeof(uint32) + sizeof(uint64));
+
+        if(cellCount > 0xffffffffULL)
+            mazeReason = "more than 2^32 cells in the Cell graph";
     }
-}
 
-void renderMaze_TwoShaded(SDL_Surface *buffer, 
-                          Maze &maze, 
-                          RGBcolor colors[4], 
-                          uint32 gradiantThreshold)
-{
-    uint32 maxDistance = maze.maxDistance;
+    uint64 imageWidth, imageHeight;
+    bool singleImage = plan_mainImage(request, imageWidth, imageHeight);
+    uint64 mainImageBytes = plan_imageBytes(imageWidth, imageHeight);
 
-    uint8 *row = (uint8 *)buffer->pixels;
-    for(uint32 X = 0;
-        X < maze.height;
-        ++X)
+    uint64 extraBytes = 0;
+    bool extrasFit = true;
+    Maze shape = {};
+    shape.width = (uint32)request.width;
+    shape.height = (uint32)request.height;
+    for(uint32 j = 0; j < request.extraOutputCount; ++j)
     {
-        uint32 *pixel = (uint32 *)row;
-        for(uint32 Y = 0;
-            Y < maze.width;
-            ++Y)
-        {
-            RGBcolor* startColor;
-            RGBcolor* maxColor;
+        uint32 outputWidth, outputHeight, scale;
+        renderOutput_size(request.extraOutputKinds[j], shape, outputWidth, outputHeight, scale);
+        extraBytes += plan_imageBytes(outputWidth, outputHeight);
+        extrasFit = extrasFit && plan_imageFits(outputWidth, outputHeight);
+    }
 
-            uint32 distanceFromStart = maze.cells[X][Y].distFromStart;
-            double coeff = 0.0f;
-            if(distanceFromStart < gradiantThreshold)
-            {
-                coeff = (double)distanceFromStart / 
-                        (double)gradiantThreshold;
-                startColor = colors;
-                maxColor = colors + 1;
-            }
-            else
-            {
-                coeff = (double)(distanceFromStart - gradiantThreshold) / 
-                        (double)(maxDistance - gradiantThreshold);
-                startColor = colors + 2;
-                maxColor = colors + 3;
-            }
+    // In memory : the maze and its images as surfaces
+    if(mazeReason)
+    {
+        plan.reasons[STRATEGY_IN_MEMORY] = mazeReason;
+    }
+    else if(request.view)
+    {
+        plan.peakBytes[STRATEGY_IN_MEMORY] = mazeBytes + 2*plan_imageBytes(VIEW_WIDTH, VIEW_HEIGHT);
+    }
+    else if(!singleImage)
+    {
+        plan.reasons[STRATEGY_IN_MEMORY] = "image too large for one BMP file";
+    }
+    else if(!extrasFit)
+    {
+        plan.reasons[STRATEGY_IN_MEMORY] = "-O output too large for one BMP file";
+    }
+    else
+    {
+        plan.peakBytes[STRATEGY_IN_MEMORY] = mazeBytes + extraBytes +
+                                             (request.mappedOutput ? 0 : mainImageBytes);
+    }
+
+    // Compact : the maze in memory, the main image mapped from its file
+#ifdef _WIN32
+    plan.reasons[STRATEGY_COMPACT] = "needs a memory mapped file";
+#else
+    if(mazeReason)
+        plan.reasons[STRATEGY_COMPACT] = mazeReason;
+    else if(request.view)
+        plan.reasons[STRATEGY_COMPACT] = "nothing to map in the viewer";
+    else if(!singleImage)
+        plan.reasons[STRATEGY_COMPACT] = "image too large for one BMP file";
+    else if(!extrasFit)
+        plan.reasons[STRATEGY_COMPACT] = "-O output too large for one BMP file";
+    else
+        plan.peakBytes[STRATEGY_COMPACT] = mazeBytes + extraBytes;
+#endif
 
-            RGBcolor cellColor;
-            cellColor.red = (startColor->red +
-                             (uint8)(coeff * (maxColor->red - startColor->red)))%256;
-            cellColor.green = (startColor->green +
-                               (uint8)(coeff * (maxColor->green - startColor->green)))%256;
-            cellColor.blue = (startColor->blue +
-                              (uint8)(coeff * (maxColor->blue - startColor->blue)))%256;
+    // Streaming : bands of rows generated, rendered and written in turn
+    uint64 bandRowBytes = 2*imageWidth*4 + 2*wordsPerRow*sizeof(uint64);
+    if(!wallBitsOnly)
+    {
+        plan.reasons[STRATEGY_STREAMING] = "needs -a binary or sidewinder and walls only";
+    }
+    else if(imageWidth*4 > 0x7fffffff)
+    {
+        plan.reasons[STRATEGY_STREAMING] = "image rows too large for a surface";
+    }
+    else
+    {
+        uint64 bandRows = STREAM_BAND_BYTES / bandRowBytes;
+        if(memoryLimit && bandRows*bandRowBytes > memoryLimit)
+            bandRows = memoryLimit / bandRowBytes;
+        if(bandRows > request.height)
+            bandRows = request.height;
+        if(bandRows == 0)
+            bandRows = 1;
+
+        plan.bandRows = (uint32)bandRows;
+        plan.peakBytes[STRATEGY_STREAMING] = bandRows*bandRowBytes;
+    }
 
-            *pixel++ = ((cellColor.red << 24) | (cellColor.green << 16) | (cellColor.blue << 8));
+    for(uint32 i = 0; i < STRATEGY_COUNT; ++i)
+    {
+        if(!plan.reasons[i] && (!memoryLimit || plan.peakBytes[i] <= memoryLimit))
+        {
+            plan.strategy = i;
+            break;
         }
-        row += buffer->pitch;
     }
 }
 
-void render_nShaded(SDL_Surface* buffer, Maze& maze,
-                    RGBcolor* colors, uint32 colorCount)
+uint64 physicalMemory()
 {
-    uint32 maxDistance = maze.maxDistance;
-    uint32 segmentCount = colorCount / 2;
-    uint32 segmentLength = maxDistance / segmentCount;
+#ifdef _WIN32
+    return 0;
+#else
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return (pages > 0 && pageSize > 0) ? (uint64)pages*pageSize : 0;
+#endif
+}
 
-    uint8 *row = (uint8 *)buffer->pixels;
-    for(uint32 X = 0;
-        X < maze.height;
-        ++X)
+// The status file is written aside and renamed over the old one
+void progress_report(ProgressReporter &reporter, const char *phaseOverride)
+{
+    static const char *phaseNames[] = { "idle", "generating", "distances", "rendering", "saving" };
+
+    int phase = progress.phase.load(std::memory_order_relaxed);
+    uint64 cells = progress.cellsVisited.load(std::memory_order_relaxed);
+    uint64 rows = progress.rowsRendered.load(std::memory_order_relaxed);
+    uint64 bytes = progress.bytesWritten.load(std::memory_order_relaxed);
+    uint64 totalCells = progress.totalCells.load(std::memory_order_relaxed);
+    uint64 totalRows = progress.totalRows.load(std::memory_order_relaxed);
+    const char *phaseName = phaseOverride ? phaseOverride : phaseNames[phase];
+
+    uint64 now = progress_now();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - reporter.start).count();
+    double phaseElapsed = (now - progress.phaseStart.load(std::memory_order_relaxed)) / 1000.0;
+
+    double fraction = 0.0;
+    if(phase == PHASE_GENERATING || phase == PHASE_DISTANCES)
+        fraction = totalCells ? (double)cells / totalCells : 0.0;
+    else if(phase == PHASE_RENDERING)
+        fraction = totalRows ? (double)rows / totalRows : 0.0;
+    double eta = (fraction > 0.0) ? phaseElapsed*(1.0 - fraction)/fraction : -1.0;
+
+    if(reporter.toStderr)
     {
-        uint32 *pixel = (uint32 *)row;
-        for(uint32 Y = 0;
-            Y < maze.width;
-            ++Y)
+        fprintf(stderr, "[%8.1fs] maze %d/%d %-10s cells %llu/%llu rows %llu/%llu bytes %llu eta %.1fs\n",
+                elapsed,
+                progress.mazeIndex.load(std::memory_order_relaxed) + 1, reporter.mazeCount,
+                phaseName,
+                (unsigned long long)cells, (unsigned long long)totalCells,
+                (unsigned long long)rows, (unsigned long long)totalRows,
+                (unsigned long long)bytes, eta);
+    }
+
+    if(reporter.statusFilename)
+    {
+        char temporaryFilename[512] = "";
+        snprintf(temporaryFilename, sizeof(temporaryFilename), "%s.tmp", reporter.statusFilename);
+        FILE *statusFile = fopen(temporaryFilename, "w");
+        if(statusFile)
         {
-            uint32 distanceFromStart = maze.cells[X][Y].distFromStart; 
-            uint32 segmentNumber = distanceFromStart / segmentLength;
+            fprintf(statusFile,
+                    "{ \"phase\": \"%s\", \"maze\": %d, \"mazeCount\": %d, "
+                    "\"cells\": %llu, \"totalCells\": %llu, "
+                    "\"rows\": %llu, \"totalRows\": %llu, \"bytes\": %llu, "
+                    "\"elapsed\": %.3f, \"eta\": %.3f }\n",
+                    phaseName,
+                    progress.mazeIndex.load(std::memory_order_relaxed), reporter.mazeCount,
+                    (unsigned long long)cells, (unsigned long long)totalCells,
+                    (unsigned long long)rows, (unsigned long long)totalRows,
+                    (unsigned long long)bytes, elapsed, eta);
+            fclose(statusFile);
+            rename(temporaryFilename, reporter.statusFilename);
+        }
+    }
+}
 
-            uint32 normalisedValue = distanceFromStart % segmentLength;
-            uint32 maxValue = segmentLength;
+void progress_reporterLoop(ProgressReporter *reporter)
+{
+    uint64 nextReport = progress_now() + PROGRESS_INTERVAL_MS;
+    while(!reporter->done.load())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
 
-            RGBcolor* startColor = colors + 2*segmentNumber;
-            RGBcolor* maxColor = colors + 2*segmentNumber + 1;
+        if(reporter->timeBudget > 0.0)
+        {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - reporter->start).count();
+            if(elapsed > reporter->timeBudget)
+            {
+                int expected = 0;
+                cancelReason.compare_exchange_strong(expected, CANCEL_TIME_BUDGET);
+            }
+        }
 
-            *pixel++ = process_linearInterpolation(normalisedValue,
-                                                   maxValue,
-                                                   startColor,
-                                                   maxColor);
+        if(progress_now() >= nextReport)
+        {
+            progress_report(*reporter, NULL);
+            nextReport += PROGRESS_INTERVAL_MS;
         }
-        row += buffer->pitch;
     }
 }
 
-void renderGradiant(SDL_Surface *buffer)
+int progress_finish(ProgressReporter &reporter, std::thread &reporterThread, bool reporting)
 {
-    uint8 *row = (uint8 *)buffer->pixels;
-    for(int Y = 0;
-        Y < buffer->h;
-        ++Y)
+    if(reporting)
     {
-        uint32 *pixel = (uint32 *)row;
-        for(int X = 0;
-            X < buffer->w;
-            ++X)
-        {
-            uint8 red = X;
-            uint8 green = Y;
-            uint8 blue = 0;
-            uint8 alpha = 0;
+        reporter.done.store(true);
+        reporterThread.join();
+        progress_report(reporter, isCancelled() ? "cancelled" : "done");
+    }
 
-            *pixel++ = ((red << 24) | (green << 16) | (blue << 8) | alpha);
-        }
-        row += buffer->pitch;
+    if(!isCancelled())
+    {
+        return 0;
+    }
+
+    int reason = cancelReason.load();
+    if(reason == CANCEL_TIME_BUDGET)
+    {
+        fprintf(stderr, "Time budget of %.1fs spent, stopped\n", reporter.timeBudget);
+        return 124;
     }
+
+    fprintf(stderr, "Interrupted by signal %d, stopped\n", reason);
+    return 128 + reason;
 }
 
 bool AreStringsEqual(const char* str1, const char* str2)
@@ -708,19 +4157,79 @@ int main (int argc, char* argv[]) {
                     both can be selected by calling the option twice
         Done* -c <n> [<color1> .. <colorn> | random] : colorpicking (n between 1 and 4)
         Done* -b <n>: batch generation
+        Done* -a [backtrack|parallel|binary|sidewinder] : generation algorithm
+        Done* -d [uniform|rand|weird|horizontal|vertical|changing] :
+                    direction policy of the backtracker
+        Done* -s <seed> : seed for a reproducible maze
+        Done* -j <n> : worker threads for the row based passes
+        Done* --stats : writes maze metrics as JSON next to the image
+        Done* --polar : circular maze, <mazeHeight> is the ring count
+        Done* -t [square|hex|triangle|cube] : grid topology, the non square
+                    ones are rendered shaded
+        Done* --depth <n> : layer count of a cube maze
+        Done* --mmap : render straight into the memory mapped BMP file
+        Done* --progress : reports progress on stderr every second
+        Done* --status-file <file> : same report as JSON, rewritten every second
+        Done* --time-budget <seconds> : stops the run once the budget is spent
+        Done* -O [walls|wallsshaded|shaded|thumbnail] : one more output
+                    written next to the image as <name>_<output>.bmp, all the
+                    outputs come from the same render pass (can be repeated)
+        Done* --view : shows the maze in a window instead of saving it,
+                    drag/arrows to pan, wheel/+/- to zoom, 0 to fit, q for the
+                    next maze of the batch
+        Done* --view-frames <n> : scripted zoom over n frames then exits,
+                    prints the frame times (works with SDL_VIDEODRIVER=dummy)
+        Done* --blob : writes the -b mazes to <fileName> as one wall bits blob,
+                    with the fixed size generator (16, 24, 32, 48 or 64 square)
+        Done* --bench-small <seconds> : mazes per second (and per core) of
+                    the fixed size generator for <mazeWidth>x<mazeHeight>
+        Done* --cache <dir> : reuses the outputs of an earlier identical request
+        Done* --cache-size <MB> : size bound of the cache, least recently used
+                    entries are evicted first (default 1024)
+        Done* --mem-limit <MB> : memory budget of one maze (default the
+                    physical memory, 0 for none), the run keeps the maze in
+                    memory, maps the image from its file or streams it band
+                    by band, whichever fits first, or stops before starting
         * -v : verbose
  */
 
-    srand(time(NULL));
-
-    int mazeWidth = 50;
-    int mazeHeight = 50;
+    uint64 mazeWidth = 50;
+    uint64 mazeHeight = 50;
     const char* filename = "maze.bmp";
 
     uint8 renderType = 0;
-    int (*randomDirFunction)() = randomDir_uniform;
+    uint32 directionPolicy = DIRECTION_UNIFORM;
+    uint32 algorithm = ALGORITHM_BACKTRACK;
+
+    uint64 seed = ((uint64)rd() << 32) | rd();
+    bool seedGiven = false;
+
+    workerCount = std::thread::hardware_concurrency();
+    if(workerCount == 0)
+    {
+        workerCount = 1;
+    }
 
     int mazeCount = 1;
+    bool writeStats = false;
+    bool polar = false;
+    bool mappedOutput = false;
+    bool smallBlob = false;
+    bool view = false;
+    uint32 viewFrames = 0;
+    double smallBenchSeconds = 0.0;
+    uint32 extraOutputKinds[OUTPUT_KIND_COUNT] = {};
+    uint32 extraOutputCount = 0;
+    const char *cacheDirectory = NULL;
+    uint64 cacheSizeLimit = (uint64)CACHE_DEFAULT_SIZE_MB << 20;
+    uint64 memoryLimit = physicalMemory();
+
+    ProgressReporter reporter = {};
+    reporter.toStderr = false;
+    reporter.statusFilename = NULL;
+    reporter.timeBudget = 0.0;
+    uint32 topology = TOPOLOGY_SQUARE;
+    int mazeDepth = 4;
 
     bool randomColor = true;
     uint32 colorCount = 2;
@@ -780,29 +4289,210 @@ int main (int argc, char* argv[]) {
                         colors[colorCount-2] = colors[colorCount-3];
                     }
 
-                    i += colorCount-1;
-                }    
+                    i += colorCount-1;
+                }    
+            }
+
+            if(AreStringsEqual(argv[i], "-d"))
+            {
+                i++;
+
+                if(AreStringsEqual(argv[i], "uniform"))
+                {
+                    directionPolicy = DIRECTION_UNIFORM;
+                }
+                else if(AreStringsEqual(argv[i], "rand"))
+                {
+                    directionPolicy = DIRECTION_RAND;
+                }
+                else if(AreStringsEqual(argv[i], "weird"))
+                {
+                    directionPolicy = DIRECTION_WEIRD;
+                }
+                else if(AreStringsEqual(argv[i], "horizontal"))
+                {
+                    directionPolicy = DIRECTION_HORIZONTAL;
+                }
+                else if(AreStringsEqual(argv[i], "vertical"))
+                {
+                    directionPolicy = DIRECTION_VERTICAL;
+                }
+                else if(AreStringsEqual(argv[i], "changing"))
+                {
+                    directionPolicy = DIRECTION_CHANGING;
+                }
+            }
+
+            if(AreStringsEqual(argv[i], "-b"))
+            {
+                i++;
+
+                mazeCount = atoi(argv[i]);
+            }
+
+            if(AreStringsEqual(argv[i], "-a"))
+            {
+                i++;
+
+                if(AreStringsEqual(argv[i], "backtrack"))
+                {
+                    algorithm = ALGORITHM_BACKTRACK;
+                }
+                else if(AreStringsEqual(argv[i], "parallel"))
+                {
+                    algorithm = ALGORITHM_PARALLEL_BACKTRACK;
+                }
+                else if(AreStringsEqual(argv[i], "binary"))
+                {
+                    algorithm = ALGORITHM_BINARY_TREE;
+                }
+                else if(AreStringsEqual(argv[i], "sidewinder"))
+                {
+                    algorithm = ALGORITHM_SIDEWINDER;
+                }
+            }
+
+            if(AreStringsEqual(argv[i], "--progress"))
+            {
+                reporter.toStderr = true;
+            }
+
+            if(AreStringsEqual(argv[i], "--status-file"))
+            {
+                i++;
+
+                reporter.statusFilename = argv[i];
+            }
+
+            if(AreStringsEqual(argv[i], "--time-budget"))
+            {
+                i++;
+
+                reporter.timeBudget = atof(argv[i]);
+            }
+
+            if(AreStringsEqual(argv[i], "--mmap"))
+            {
+                mappedOutput = true;
+            }
+
+            if(AreStringsEqual(argv[i], "-O"))
+            {
+                i++;
+
+                for(uint32 kind = 0; kind < OUTPUT_KIND_COUNT; ++kind)
+                {
+                    if(AreStringsEqual(argv[i], renderOutput_name(kind)) &&
+                       extraOutputCount < OUTPUT_KIND_COUNT)
+                    {
+                        extraOutputKinds[extraOutputCount++] = kind;
+                    }
+                }
+            }
+
+            if(AreStringsEqual(argv[i], "--view"))
+            {
+                view = true;
+            }
+
+            if(AreStringsEqual(argv[i], "--view-frames"))
+            {
+                i++;
+
+                view = true;
+                viewFrames = atoi(argv[i]);
+            }
+
+            if(AreStringsEqual(argv[i], "--blob"))
+            {
+                smallBlob = true;
+            }
+
+            if(AreStringsEqual(argv[i], "--bench-small"))
+            {
+                i++;
+
+                smallBenchSeconds = atof(argv[i]);
+            }
+
+            if(AreStringsEqual(argv[i], "--cache"))
+            {
+                i++;
+
+                cacheDirectory = argv[i];
+            }
+
+            if(AreStringsEqual(argv[i], "--cache-size"))
+            {
+                i++;
+
+                cacheSizeLimit = strtoull(argv[i], nullptr, 0) << 20;
+            }
+
+            if(AreStringsEqual(argv[i], "--polar"))
+            {
+                polar = true;
+            }
+
+            if(AreStringsEqual(argv[i], "-t"))
+            {
+                i++;
+
+                if(AreStringsEqual(argv[i], "square"))
+                {
+                    topology = TOPOLOGY_SQUARE;
+                }
+                else if(AreStringsEqual(argv[i], "hex"))
+                {
+                    topology = TOPOLOGY_HEX;
+                }
+                else if(AreStringsEqual(argv[i], "triangle"))
+                {
+                    topology = TOPOLOGY_TRIANGLE;
+                }
+                else if(AreStringsEqual(argv[i], "cube"))
+                {
+                    topology = TOPOLOGY_CUBE;
+                }
+            }
+
+            if(AreStringsEqual(argv[i], "--depth"))
+            {
+                i++;
+
+                mazeDepth = atoi(argv[i]);
+                if(mazeDepth < 1)
+                {
+                    mazeDepth = 1;
+                }
+            }
+
+            if(AreStringsEqual(argv[i], "--stats"))
+            {
+                writeStats = true;
+            }
+
+            if(AreStringsEqual(argv[i], "-s"))
+            {
+                i++;
+
+                seed = strtoull(argv[i], nullptr, 0);
+                seedGiven = true;
             }
 
-            if(AreStringsEqual(argv[i], "-d"))
+            if(AreStringsEqual(argv[i], "--mem-limit"))
             {
                 i++;
 
-                if(AreStringsEqual(argv[i], "uniform"))
-                {
-                    randomDirFunction = randomDir_uniform;
-                }
-                else if(AreStringsEqual(argv[i], "rand"))
-                {
-                    randomDirFunction = randomDir_usingRand;
-                }
+                memoryLimit = strtoull(argv[i], nullptr, 10) << 20;
             }
 
-            if(AreStringsEqual(argv[i], "-b"))
+            if(AreStringsEqual(argv[i], "-j"))
             {
                 i++;
 
-                mazeCount = atoi(argv[i]);
+                int threads = atoi(argv[i]);
+                workerCount = (threads > 0) ? threads : 1;
             }
         }
     }
@@ -812,36 +4502,286 @@ int main (int argc, char* argv[]) {
         renderType = 3;
     }
 
-    mazeWidth = atoi(argv[1]);
-    mazeHeight = atoi(argv[2]);
+    srand((unsigned int)seed);
+    engine.seed((std::mt19937::result_type)seed);
+
+    mazeWidth = strtoull(argv[1], nullptr, 10);
+    mazeHeight = strtoull(argv[2], nullptr, 10);
     filename = argv[3];
 
+    bool otherTopology = (!polar && topology != TOPOLOGY_SQUARE);
+    if(mazeWidth == 0 || mazeWidth > MAZE_MAX_SIDE ||
+       mazeHeight == 0 || mazeHeight > MAZE_MAX_SIDE)
+    {
+        printf("The maze sides go from 1 to %llu cells\n", MAZE_MAX_SIDE);
+        return 2;
+    }
+
+    // A single column of triangles has no flat side between its rows
+    if(otherTopology && topology == TOPOLOGY_TRIANGLE && mazeWidth < 2)
+    {
+        printf("A triangle maze is at least 2 cells wide\n");
+        return 2;
+    }
+
+    // The cube layers are stacked on the rows, checked before multiplying
+    uint64 gridHeight = mazeHeight;
+    if(otherTopology && topology == TOPOLOGY_CUBE)
+    {
+        if((uint64)mazeDepth > MAZE_MAX_SIDE / mazeHeight)
+        {
+            printf("A cube maze has at most %llu rows over all its layers\n", MAZE_MAX_SIDE);
+            return 2;
+        }
+        gridHeight = mazeHeight*mazeDepth;
+    }
+
     Maze maze = {};
-    maze.width = mazeWidth;
-    maze.height = mazeHeight;
+    maze.width = (uint32)mazeWidth;
+    maze.height = (uint32)mazeHeight;
+    maze.depth = 1;
 
-    SDL_Init(SDL_INIT_VIDEO);
+    if(otherTopology && (algorithm != ALGORITHM_BACKTRACK || directionPolicy != DIRECTION_UNIFORM))
+    {
+        printf("Non square topologies only have the uniform backtracker, ignoring -a and -d\n");
+        algorithm = ALGORITHM_BACKTRACK;
+        directionPolicy = DIRECTION_UNIFORM;
+    }
+    if(polar && algorithm != ALGORITHM_BACKTRACK)
+    {
+        printf("Polar mazes only have the backtracker, ignoring -a\n");
+        algorithm = ALGORITHM_BACKTRACK;
+    }
+    if((algorithm == ALGORITHM_BINARY_TREE || algorithm == ALGORITHM_SIDEWINDER) &&
+       directionPolicy != DIRECTION_UNIFORM)
+    {
+        printf("-d only applies to the backtrackers, ignoring it\n");
+        directionPolicy = DIRECTION_UNIFORM;
+    }
+
+    if(otherTopology)
+    {
+        renderType = RENDER_SHADED;
+        if(topology == TOPOLOGY_CUBE)
+        {
+            maze.depth = mazeDepth;
+            maze.height = (uint32)gridHeight;
+        }
+    }
+
+    if(cacheDirectory && !seedGiven)
+    {
+        printf("The cache needs a fixed seed (-s), not using it\n");
+        cacheDirectory = NULL;
+    }
+#ifdef _WIN32
+    if(cacheDirectory)
+    {
+        printf("The cache isn't supported on this platform\n");
+        cacheDirectory = NULL;
+    }
+#else
+    if(cacheDirectory && mkdir(cacheDirectory, 0755) != 0 && errno != EEXIST)
+    {
+        printf("Couldn't create the cache directory %s\n", cacheDirectory);
+        cacheDirectory = NULL;
+    }
+#endif
+
+    if(view && (polar || otherTopology))
+    {
+        printf("The viewer shows square mazes only\n");
+        view = false;
+    }
+
+    if(extraOutputCount && (polar || otherTopology))
+    {
+        printf("Extra outputs need a square maze, ignoring them\n");
+        extraOutputCount = 0;
+    }
 
-    uint32 mazeSurfaceWidth = maze.width;
-    uint32 mazeSurfaceHeight = maze.height;
+    uint32 mainOutputKind = OUTPUT_SHADED;
     if(renderType & RENDER_WALLS)
     {
-        mazeSurfaceWidth = maze.width*2 + 1;
-        mazeSurfaceHeight = maze.height*2 + 1;
+        mainOutputKind = (renderType & RENDER_SHADED) ? OUTPUT_WALLS_SHADED : OUTPUT_WALLS;
+    }
+
+    SDL_Init(SDL_INIT_VIDEO);
+
+    MemoryRequest memoryRequest = {};
+    memoryRequest.width = maze.width;
+    memoryRequest.height = maze.height;
+    memoryRequest.algorithm = algorithm;
+    memoryRequest.topology = topology;
+    memoryRequest.polar = polar;
+    memoryRequest.renderType = renderType;
+    memoryRequest.extraOutputKinds = extraOutputKinds;
+    memoryRequest.extraOutputCount = extraOutputCount;
+    memoryRequest.writeStats = writeStats;
+    memoryRequest.mappedOutput = mappedOutput;
+    memoryRequest.view = view;
+
+    uint64 mazeSurfaceWidth, mazeSurfaceHeight;
+    plan_mainImage(memoryRequest, mazeSurfaceWidth, mazeSurfaceHeight);
+
+    int exitCode = 0;
+
+    // Stopped runs exit with 128+signal, or 124 once the time budget is spent
+    signal(SIGINT, cancelHandler);
+    signal(SIGTERM, cancelHandler);
+
+    reporter.mazeCount = mazeCount;
+    reporter.start = std::chrono::steady_clock::now();
+    reporter.done.store(false);
+    std::thread reporterThread;
+    bool reporting = (reporter.toStderr || reporter.statusFilename || reporter.timeBudget > 0.0);
+    if(reporting)
+    {
+        reporterThread = std::thread(progress_reporterLoop, &reporter);
+    }
+
+    if(smallBlob || smallBenchSeconds > 0.0)
+    {
+        progress.mazeIndex.store(0);
+        progress_setPhase(PHASE_GENERATING);
+
+        bool supported = true;
+        bool blobWritten = true;
+        if(smallBenchSeconds > 0.0)
+        {
+            SmallMazeBenchmark benchmark = { seed, smallBenchSeconds };
+            supported = dispatch_smallMazeSize(mazeWidth, mazeHeight, benchmark);
+        }
+        else
+        {
+            FILE *blobFile = fopen(filename, "wb");
+            if(!blobFile)
+            {
+                printf("Couldn't open %s\n", filename);
+                progress_finish(reporter, reporterThread, reporting);
+                SDL_Quit();
+                return 1;
+            }
+
+            SmallMazeBlobWriter writer = { blobFile, seed, (uint32)mazeCount, false };
+            supported = dispatch_smallMazeSize(mazeWidth, mazeHeight, writer);
+            blobWritten = (fclose(blobFile) == 0 && writer.written);
+
+            if(!supported || isCancelled() || !blobWritten)
+            {
+                remove(filename);
+            }
+            else
+            {
+                printf("%d mazes written to %s\n", mazeCount, filename);
+            }
+        }
+
+        exitCode = progress_finish(reporter, reporterThread, reporting);
+        if(supported && !blobWritten && !isCancelled())
+        {
+            printf("Blob couldn't be saved to %s\n", filename);
+            exitCode = 1;
+        }
+        if(!supported)
+        {
+            printf("The fixed size mazes are 16x16, 24x24, 32x32, 48x48 or 64x64\n");
+            exitCode = 1;
+        }
+
+        SDL_Quit();
+        return exitCode;
+    }
+
+    MemoryPlan memoryPlan = {};
+    plan_memory(memoryPlan, memoryRequest, memoryLimit);
+    if(memoryPlan.strategy == STRATEGY_NONE)
+    {
+        if(memoryLimit)
+            printf("The maze doesn't fit in %llu MB :\n", (unsigned long long)(memoryLimit >> 20));
+        else
+            printf("The maze can't be made :\n");
+        for(uint32 j = 0; j < STRATEGY_COUNT; j++)
+        {
+            if(memoryPlan.reasons[j])
+            {
+                printf("    %s : %s\n", strategy_name(j), memoryPlan.reasons[j]);
+            }
+            else
+            {
+                printf("    %s : about %llu MB\n", strategy_name(j),
+                       (unsigned long long)((memoryPlan.peakBytes[j] + (1 << 20) - 1) >> 20));
+            }
+        }
+        progress_finish(reporter, reporterThread, reporting);
+        SDL_Quit();
+        return 2;
+    }
+
+    printf("Memory plan : %s, about %llu MB per maze",
+           strategy_name(memoryPlan.strategy),
+           (unsigned long long)((memoryPlan.peakBytes[memoryPlan.strategy] + (1 << 20) - 1) >> 20));
+    if(memoryLimit)
+    {
+        printf(" of %llu MB", (unsigned long long)(memoryLimit >> 20));
     }
+    printf("\n");
+
+    if(memoryPlan.strategy == STRATEGY_COMPACT)
+    {
+        mappedOutput = true;
+    }
+    if(memoryPlan.strategy == STRATEGY_STREAMING && cacheDirectory)
+    {
+        printf("Streamed images aren't cached\n");
+        cacheDirectory = NULL;
+    }
+
 
 #if 1
     for(int i = 0; i < mazeCount; i++)
     {
-        SDL_Surface* mazeSurface = {};
-        mazeSurface = SDL_CreateRGBSurface(0,
-                                           mazeSurfaceWidth,
-                                           mazeSurfaceHeight,
-                                           32,
-                                           0xff000000,
-                                           0x00ff0000,
-                                           0x0000ff00,
-                                           0x000000ff);
+        char filenameArray[512] = "";
+        if(mazeCount > 1)
+        {
+            char* tmpBuffer = (char*)filename;
+
+            int lastDotIndex = FindLastDot(filename);
+            if(lastDotIndex >= 0)
+            {
+                tmpBuffer[lastDotIndex] = '\0';
+            }
+
+            sprintf(filenameArray, "%s%d.bmp", tmpBuffer, i);
+        }
+        else
+        {
+            strcpy(filenameArray, filename);
+        }
+
+        bool mazeStats = (writeStats && !polar && !otherTopology);
+        char statsFilename[512] = "";
+        strcpy(statsFilename, filenameArray);
+        int statsDotIndex = FindLastDot(statsFilename);
+        if(statsDotIndex >= 0)
+        {
+            statsFilename[statsDotIndex] = '\0';
+        }
+        strcat(statsFilename, ".json");
+
+        char extraFilenames[OUTPUT_KIND_COUNT][512] = {};
+        char extraExtensions[OUTPUT_KIND_COUNT][32] = {};
+        for(uint32 j = 0; j < extraOutputCount; j++)
+        {
+            sprintf(extraExtensions[j], "_%s.bmp", renderOutput_name(extraOutputKinds[j]));
+            strcpy(extraFilenames[j], statsFilename);
+            extraFilenames[j][strlen(statsFilename) - strlen(".json")] = '\0';
+            strcat(extraFilenames[j], extraExtensions[j]);
+        }
+
+        maze.seed = random_counter64(seed, i);
+        srand((unsigned int)maze.seed);
+        engine.seed((std::mt19937::result_type)maze.seed);
 
         if(randomColor)
         {
@@ -855,86 +4795,339 @@ int main (int argc, char* argv[]) {
 				colors[colorCount - 2] = colors[colorCount - 3];
             }
         }
+        if(view)
+        {
+            progress.mazeIndex.store(i);
+            progress.totalCells.store((uint64)maze.width*maze.height);
+            progress_setPhase(PHASE_GENERATING);
+
+            printf("Building maze %d..\n", i);
+            buildMaze(maze, algorithm, directionPolicy);
+            bool nextMaze = true;
+            if(!isCancelled())
+            {
+                printf("Maze built\n");
+                progress_setPhase(PHASE_RENDERING);
+                nextMaze = viewMaze(maze, mainOutputKind, colors, colorCount, viewFrames);
+            }
+            destroyMaze(maze);
+
+            if(!nextMaze || isCancelled())
+            {
+                break;
+            }
+            continue;
+        }
+
+        if(memoryPlan.strategy == STRATEGY_STREAMING)
+        {
+            progress.mazeIndex.store(i);
+            progress.totalCells.store((uint64)maze.width*maze.height);
+            progress.totalRows.store(mazeSurfaceHeight);
+            progress.rowSize.store(mazeSurfaceWidth*4);
+            progress.mappedOutput.store(false);
+            progress.rowsRendered.store(0);
+            progress.bytesWritten.store(0);
+            progress_setPhase(PHASE_RENDERING);
+
+            printf("Streaming maze %d..\n", i);
+            if(streamWallBitsMaze(filenameArray, maze.width, maze.height,
+                                  algorithm, maze.seed, memoryPlan.bandRows))
+            {
+                printf("Maze saved\n\n");
+            }
+            else if(!isCancelled())
+            {
+                printf("Image couldn't be saved to %s\n", filenameArray);
+                exitCode = 1;
+            }
+
+            if(isCancelled())
+            {
+                break;
+            }
+            continue;
+        }
+
+        uint64 cacheKey = 0;
+        if(cacheDirectory)
+        {
+            cacheKey = cacheKey_forMaze(maze, algorithm, directionPolicy, topology, polar,
+                                        renderType, colors, colorCount, mappedOutput);
+            bool cached = (cache_fetch(cacheDirectory, cacheKey, ".bmp", filenameArray) &&
+                           (!mazeStats || cache_fetch(cacheDirectory, cacheKey, ".json", statsFilename)));
+            for(uint32 j = 0; cached && j < extraOutputCount; j++)
+            {
+                cached = cache_fetch(cacheDirectory, cacheKey, extraExtensions[j], extraFilenames[j]);
+            }
+            if(cached)
+            {
+                printf("Maze %d served from the cache (%016llx)\n\n", i, (unsigned long long)cacheKey);
+                continue;
+            }
+        }
+
+        SDL_Surface* mazeSurface = {};
+        MappedImage mappedImage = {};
+        if(mappedOutput)
+        {
+            if(!openMappedBMP(mappedImage, filenameArray,
+                              (uint32)mazeSurfaceWidth, (uint32)mazeSurfaceHeight))
+            {
+                if(memoryPlan.strategy == STRATEGY_COMPACT)
+                {
+                    printf("Couldn't map %s\n", filenameArray);
+                    exitCode = 1;
+                    break;
+                }
+                printf("Couldn't map %s, falling back to a surface\n", filenameArray);
+                mappedOutput = false;
+            }
+            else
+            {
+                mazeSurface = &mappedImage.surface;
+            }
+        }
+        if(!mappedOutput)
+        {
+            mazeSurface = SDL_CreateRGBSurface(0,
+                                               (int)mazeSurfaceWidth,
+                                               (int)mazeSurfaceHeight,
+                                               32,
+                                               0xff000000,
+                                               0x00ff0000,
+                                               0x0000ff00,
+                                               0x000000ff);
+        }
+
+        RenderOutput outputs[1 + OUTPUT_KIND_COUNT] = {};
+        outputs[0].kind = mainOutputKind;
+        outputs[0].surface = mazeSurface;
+        for(uint32 j = 0; j < extraOutputCount; j++)
+        {
+            RenderOutput &output = outputs[1 + j];
+            uint32 outputWidth, outputHeight;
+            output.kind = extraOutputKinds[j];
+            renderOutput_size(output.kind, maze, outputWidth, outputHeight, output.scale);
+            output.surface = SDL_CreateRGBSurface(0,
+                                                  outputWidth,
+                                                  outputHeight,
+                                                  32,
+                                                  0xff000000,
+                                                  0x00ff0000,
+                                                  0x0000ff00,
+                                                  0x000000ff);
+        }
+
+        // The walls of the row based generators are drawn from their bits
+        bool wallBitsOnly = (!writeStats && !polar && !otherTopology && !extraOutputCount &&
+                             renderType == RENDER_WALLS &&
+                             (algorithm == ALGORITHM_BINARY_TREE ||
+                              algorithm == ALGORITHM_SIDEWINDER));
+        WallBits bits = {};
+        PolarMaze polarMaze = {};
+
+        progress.mazeIndex.store(i);
+        progress.totalCells.store(polar ? 0 : (uint64)maze.width*maze.height);
+        progress.totalRows.store(mazeSurfaceHeight);
+        progress.rowSize.store((uint64)mazeSurfaceWidth*4);
+        progress.mappedOutput.store(mappedOutput);
+        progress.rowsRendered.store(0);
+        progress.bytesWritten.store(0);
+        progress_setPhase(PHASE_GENERATING);
+
         printf("Building maze %d..\n", i);
-        buildMaze(maze, randomDirFunction);
-        printf("Maze built\n");
+        if(polar)
+        {
+            buildPolarMaze(polarMaze, maze.height);
+            progress.totalCells.store(polarMaze.ringOffsets[polarMaze.rings]);
+            PolarBacktrackGenerator generator = { polarMaze };
+            dispatch_directionPolicy(directionPolicy, generator);
+        }
+        else if(otherTopology)
+        {
+            // Built along with the rendering, see renderTopologyMaze
+        }
+        else if(wallBitsOnly)
+        {
+            buildWallBits(bits, maze.width, maze.height);
+            if(algorithm == ALGORITHM_BINARY_TREE)
+                generate_binaryTree(bits, maze.seed);
+            else
+                generate_sidewinder(bits, maze.seed);
+        }
+        else
+        {
+            buildMaze(maze, algorithm, directionPolicy);
+        }
+        printf(isCancelled() ? "Maze generation stopped\n" : "Maze built\n");
 
-        printf("Rendering the maze.. \n");
-        if((renderType & RENDER_WALLS) != 0)
+        if(!isCancelled())
         {
-            if((renderType & RENDER_SHADED) != 0)
+            printf("Rendering the maze.. \n");
+            progress_setPhase(PHASE_RENDERING);
+            if(polar)
+            {
+                renderPolarMaze_Walls(mazeSurface, polarMaze);
+            }
+            else if(otherTopology)
             {
-                renderMaze_WallsShaded(mazeSurface, maze, colors[0], colors[1]);
+                switch(topology)
+                {
+                case TOPOLOGY_HEX:
+                    renderTopologyMaze<HexTopology>(mazeSurface, maze, colors, colorCount);
+                    break;
+                case TOPOLOGY_TRIANGLE:
+                    renderTopologyMaze<TriangleTopology>(mazeSurface, maze, colors, colorCount);
+                    break;
+                case TOPOLOGY_CUBE:
+                    renderTopologyMaze<CubeTopology>(mazeSurface, maze, colors, colorCount);
+                    break;
+                }
+            }
+            else if(wallBitsOnly)
+            {
+                renderWallBits_Walls(mazeSurface, bits);
             }
             else
             {
-                renderMaze_Walls(mazeSurface, maze);
+                renderMaze_Outputs(maze, outputs, 1 + extraOutputCount, colors, colorCount);
+            }
+
+            printf("Maze rendered\n");
+        }
+
+        MazeStats stats = {};
+        if(mazeStats && !isCancelled())
+        {
+            printf("Computing maze stats..\n");
+            process_mazeStats(maze, stats);
+        }
+
+        bool imageSaved = false;
+        bool statsSaved = false;
+        if(isCancelled())
+        {
+            if(mappedOutput)
+            {
+                discardMappedBMP(mappedImage, filenameArray);
             }
         }
-        else if((renderType & RENDER_SHADED) != 0)
+        else
         {
-            switch(colorCount)
+            printf("Saving the maze to a file..\n");
+            progress_setPhase(PHASE_SAVING);
+
+            if(mappedOutput)
             {
-				case 0:
-					break;
-                case 1:
-                case 2:
+                imageSaved = closeMappedBMP(mappedImage);
+                if(!imageSaved)
                 {
-                    renderMaze_Shaded(mazeSurface, maze, colors[0], colors[1]); 
-                } break;
-                case 3:
+                    printf("Image couldn't be saved to %s : %s\n", filenameArray, strerror(errno));
+                    remove(filenameArray);
+                    exitCode = 1;
+                }
+            }
+            else if(SDL_SaveBMP(mazeSurface, filenameArray))
+            {
+                printf("Image couldn't be saved : \n%s\n", SDL_GetError());
+                exitCode = 1;
+            }
+            else
+            {
+                progress.bytesWritten.fetch_add(progress.totalRows.load()*progress.rowSize.load());
+                imageSaved = true;
+            }
+
+            uint32 extrasSaved = 0;
+            for(; extrasSaved < extraOutputCount && !isCancelled(); extrasSaved++)
+            {
+                if(SDL_SaveBMP(outputs[1 + extrasSaved].surface, extraFilenames[extrasSaved]))
                 {
-                    renderMaze_TwoShaded(mazeSurface, 
-                                         maze, 
-                                         colors, 
-                                         maze.maxDistance / 2);
-                } break;
-                case 4:
+                    printf("Image couldn't be saved : \n%s\n", SDL_GetError());
+                    imageSaved = false;
+                    exitCode = 1;
+                }
+            }
+            printf("Maze saved\n\n");
+
+            if(mazeStats && !isCancelled())
+            {
+                FILE *statsFile = fopen(statsFilename, "w");
+                if(statsFile)
                 {
-                    renderMaze_TwoShaded(mazeSurface, 
-                                         maze, 
-                                         colors,
-                                         maze.maxDistance / 2);
-                } break;
-				default:
-				{
-					render_nShaded(mazeSurface,
-						maze,
-						colors,
-						colorCount);
-				}
+                    writeMazeStats(statsFile, maze, stats);
+                    statsSaved = (fclose(statsFile) == 0);
+                    printf("Stats saved\n\n");
+                }
+                else
+                {
+                    printf("Stats couldn't be saved to %s\n", statsFilename);
+                }
             }
-        }
 
-        printf("Maze rendered\n");
-        printf("Saving the maze to a file..\n");
+            if(isCancelled())
+            {
+                remove(filenameArray);
+                for(uint32 j = 0; j < extrasSaved; j++)
+                {
+                    remove(extraFilenames[j]);
+                }
+                if(statsSaved)
+                {
+                    remove(statsFilename);
+                }
+                imageSaved = false;
+                statsSaved = false;
+                printf("Saving stopped, the outputs were removed\n\n");
+            }
+        }
 
-        char filenameArray[512] = "";
-        if(mazeCount > 1)
+        if(cacheDirectory && imageSaved && !isCancelled())
         {
-            char* tmpBuffer = (char*)filename;
-
-            int lastDotIndex = FindLastDot(filename);
-            if(lastDotIndex >= 0)
+            cache_store(cacheDirectory, cacheKey, ".bmp", filenameArray);
+            if(statsSaved)
             {
-                tmpBuffer[lastDotIndex] = '\0';
+                cache_store(cacheDirectory, cacheKey, ".json", statsFilename);
             }
+            for(uint32 j = 0; j < extraOutputCount; j++)
+            {
+                cache_store(cacheDirectory, cacheKey, extraExtensions[j], extraFilenames[j]);
+            }
+            cache_evict(cacheDirectory, cacheSizeLimit);
+        }
 
-            sprintf(filenameArray, "%s%d.bmp", tmpBuffer, i);
+        if(polar)
+        {
+            destroyPolarMaze(polarMaze);
         }
-        else
+        else if(wallBitsOnly)
         {
-            strcpy(filenameArray, filename);
+            destroyWallBits(bits);
+        }
+        else if(!otherTopology)
+        {
+            destroyMaze(maze);
+        }
+        if(!mappedOutput)
+        {
+            SDL_FreeSurface(mazeSurface);
+        }
+        for(uint32 j = 0; j < extraOutputCount; j++)
+        {
+            SDL_FreeSurface(outputs[1 + j].surface);
         }
 
-        if(SDL_SaveBMP(mazeSurface, filenameArray))
+        if(isCancelled())
         {
-            printf("Image couldn't be saved : \n%s\n", SDL_GetError());
+            break;
         }
-        printf("Maze saved\n\n");
+    }
 
-        destroyMaze(maze);
-        SDL_FreeSurface(mazeSurface);
+    int stopCode = progress_finish(reporter, reporterThread, reporting);
+    if(stopCode)
+    {
+        exitCode = stopCode;
     }
 
 #else
@@ -974,7 +5167,7 @@ int main (int argc, char* argv[]) {
     MakeRandomColor(&testColors[5]);
 #endif
 
-    buildMaze(maze, randomDirFunction);
+    buildMaze(maze, algorithm, directionPolicy);
 
     SDL_Surface* mazeSurface = SDL_CreateRGBSurface(0,
                                     mazeWidth,
@@ -991,5 +5184,5 @@ int main (int argc, char* argv[]) {
 
     SDL_Quit();
 
-    return 0;
+    return exitCode;
 }